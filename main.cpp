@@ -25,6 +25,8 @@ int main() {
   disk_worker.detach();
   std::thread cpu_plot_worker(FetchCpuUsageForPlot);
   cpu_plot_worker.detach();
+  std::thread proc_worker(FetchProcesses);
+  proc_worker.detach();
   // std::thread show_thread(ShowCpuUsage);
   std::thread p(WriteSystemJson);
 
@@ -70,7 +72,6 @@ int main() {
   ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
   bool dock_window = true;
   bool done = false;
-  Uint32 last_update_time = 0; // Time in millis
 
   while (!done) {
     SDL_Event event;
@@ -92,14 +93,6 @@ int main() {
       continue;
     }
 
-    // Update process list every 2 seconds before imgui frame starts
-    Uint32 current_time = SDL_GetTicks(); // Get time in milliseconds
-    if (current_time - last_update_time >= 2000) {
-      FetchProcesses();
-      // GetCpuUsage();
-      last_update_time = current_time;
-    }
-
     // Start the Dear ImGui frame
     ImGui_ImplSDLRenderer2_NewFrame();
     ImGui_ImplSDL2_NewFrame();
@@ -3,17 +3,31 @@
 #include "imgui_internal.h"
 #include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <fcntl.h>
+#include <memory>
+#include <memory_resource>
 #include <mutex>
 #include <pwd.h>
+#include <sched.h>
 #include <string>
+#include <string_view>
 #include <sys/stat.h>
 #include <thread>
 #include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
 #define STAT_FILE_PATH "/proc/stat"
 #define MAX_CORES 128
 #define SLEEP_INTERVAL 1
+#define PROC_REFRESH_MS 2000
+#define MAX_SCAN_WORKERS 16
+#define PROC_RESYNC_SCANS 15 // full /proc listing at least this often with proc events, 30s
+#define MAX_FROZEN_PINNED 8
+#define PROC_HISTORY_SIZE 150            // samples per process, 5 minutes at PROC_REFRESH_MS
+#define PROC_HISTORY_MAX_BYTES (8 << 20) // all per-process histories together
+#define PROC_MEMORY_REFRESH_MS 6000      // PSS/USS/Swap, a slower rate than the scan
 
 extern std::atomic<bool> is_finished;
 extern std::string search_query;
@@ -24,17 +38,402 @@ extern std::atomic<float> read_speed;
 //
 //
 
-typedef struct {
-    std::string Pid;
-    std::string Name;
-    std::string ParentId;        // parent PID
-    std::string User;
-    std::string Command;
-    float CpuUsage;
-    float MemUsage;
-    int ThreadCount;
-    std::vector<int> Children; // indices into Procs
-} Process;
+// Fields parsed from a single read of /proc/[pid]/stat and /proc/[pid]/status
+struct ProcSample {
+    int ppid = 0;
+    char state = '?';
+    unsigned long long utime = 0, stime = 0; // clock ticks
+    unsigned long long start_time = 0;       // clock ticks since boot
+    unsigned long long minflt = 0, majflt = 0; // page faults without and with disk I/O
+    unsigned long long vcsw = 0, nvcsw = 0;    // voluntary and involuntary context switches
+    int threads = 0;
+    long rss_kb = 0;
+    unsigned uid = 0;
+    char name[64] = "";
+    // /proc/[pid]/io, cumulative since the process started
+    unsigned long long read_bytes = 0, write_bytes = 0; // actually went to storage
+    unsigned long long syscr = 0, syscw = 0;            // read and write syscalls
+    bool io = false;                                    // the io file could be read
+};
+
+// Proportional and unique memory from /proc/[pid]/smaps_rollup. The kernel
+// walks the page tables to produce it, so it is only read for rows on screen.
+struct ProcMemory {
+    long pss_kb = 0;  // shared pages split evenly between the processes mapping them
+    long uss_kb = 0;  // private pages only, what exiting would give back
+    long swap_kb = 0;
+    bool readable = false; // smaps_rollup needs ptrace access to the process
+};
+
+// Reads per-process files through one reusable buffer and counts the
+// syscalls it issues, so a scan can report what it cost.
+class ProcReader {
+public:
+    bool Read(int pid, ProcSample &out);
+    std::string ReadCommand(int pid);
+    bool ReadMemory(int pid, ProcMemory &out);
+    bool ReadIo(int pid, ProcSample &out); // sets errno on failure, EACCES if not ours
+    bool ListTasks(int pid, std::vector<int> &tids);
+    bool ReadTask(int pid, int tid, ProcSample &out); // stat only; name is the thread's comm
+    double ReadUptime();
+
+    int proc_fd = AT_FDCWD; // paths are opened relative to this (ProcDir::Fd())
+    unsigned long long syscalls = 0;
+
+private:
+    int ReadFile(const char *path);
+    char buffer[8192];
+};
+
+// Identity of a process across scans. The start time tells a recycled PID
+// apart from the process that used it before.
+struct ProcKey {
+    int pid;
+    unsigned long long start_time;
+    bool operator==(const ProcKey &other) const {
+        return pid == other.pid && start_time == other.start_time;
+    }
+};
+
+struct ProcKeyHash {
+    size_t operator()(const ProcKey &key) const {
+        return std::hash<unsigned long long>()(
+            ((unsigned long long)key.pid << 32) ^ key.start_time);
+    }
+};
+
+// Sampler-side record of a live process. The strings are read once when the
+// process first shows up; only the sample is refreshed on later scans.
+struct ProcEntry {
+    int pid = 0;
+    std::string name;
+    std::string user;
+    std::string command;
+    ProcSample sample;
+    unsigned long long prev_ticks = 0; // utime + stime at the previous sample
+    double prev_uptime = 0.0;          // when that was taken, 0 = no baseline yet
+    float cpu_usage = 0.0f;            // over the last interval, 100% = one core
+    float io_read_rate = -1.0f;        // bytes/s over the same interval, -1 = io unreadable
+    float io_write_rate = -1.0f;
+    float syscr_rate = -1.0f;          // syscalls/s
+    float syscw_rate = -1.0f;
+    float minflt_rate = 0.0f;          // per second, like the CPU delta
+    float majflt_rate = 0.0f;
+    float vcsw_rate = 0.0f;
+    float nvcsw_rate = 0.0f;
+    bool io_denied = false;            // EACCES once, so not tried again
+    unsigned long long seen_scan = 0;
+    bool details = false;              // user and command loaded (top-N defers them)
+};
+
+// Held /proc directory fd. Lists PIDs with raw getdents64 calls instead of
+// a directory_iterator plus a stat() per entry.
+class ProcDir {
+public:
+    ProcDir();
+    ~ProcDir();
+    ProcDir(const ProcDir &) = delete;
+    ProcDir &operator=(const ProcDir &) = delete;
+
+    bool ListPids(std::vector<int> &pids);
+    int Fd() const { return fd; }
+
+    unsigned long long syscalls = 0;
+
+private:
+    int fd = -1;
+    char buffer[32768];
+};
+
+// UID -> user name, filled lazily. NSS lookups can go over the network
+// (sssd, LDAP), so each UID is resolved once until /etc/passwd changes.
+// Lookup() is safe to call from several scan workers at once.
+class UserCache {
+public:
+    const std::string &Lookup(unsigned uid);
+    void Revalidate(); // once per scan, before the workers start
+
+private:
+    std::mutex mtx;
+    std::unordered_map<unsigned, std::string> names;
+    struct timespec passwd_mtime = {};
+};
+
+// PIDs the UI asked the sampler about since the last scan, with the start
+// time that tells a recycled PID apart. The UI adds the rows it draws; after
+// a scan the sampler takes the set and reads only those, so processes off
+// screen cost nothing. Capped at more than a screenful of rows.
+class WantedPids {
+public:
+    void Want(int pid, unsigned long long start_time);
+    void Take(std::unordered_map<int, unsigned long long> &out); // pid -> start time
+
+private:
+    std::mutex mtx;
+    std::unordered_map<int, unsigned long long> pids;
+};
+
+struct ProcScanStats {
+    size_t processes = 0;              // rows in the snapshot
+    size_t scanned = 0;                // live processes read, can be more in top-N mode
+    int top_n = 0;                     // the snapshot holds only the N heaviest, 0 = all
+    unsigned long long syscalls = 0;
+    int workers = 1;
+    float scan_ms = 0.0f;        // wall time of the whole scan
+    bool events = false;         // table kept up to date by the proc connector
+    unsigned long long event_only = 0; // processes that lived and died between scans
+    size_t arena_allocations = 0;      // served by the snapshot arena this scan
+    size_t arena_bytes = 0;
+    size_t arena_mallocs = 0;          // new arena blocks this scan, 0 in steady state
+};
+
+// Bump allocator owned by a snapshot. Everything a scan builds comes from it;
+// deallocation is a no-op and Reset() rewinds without giving the blocks back,
+// so a recycled snapshot stops hitting malloc after a scan or two.
+class ScanArena : public std::pmr::memory_resource {
+public:
+    ScanArena() = default;
+    ScanArena(const ScanArena &) = delete;
+    ScanArena &operator=(const ScanArena &) = delete;
+    ~ScanArena();
+
+    void Reset(); // only once nothing allocated from it is used anymore
+
+    size_t allocations = 0; // since the last Reset()
+    size_t bytes = 0;
+    size_t mallocs = 0;
+
+private:
+    void *do_allocate(size_t size, size_t align) override;
+    void do_deallocate(void *, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+    struct Block {
+        char *data;
+        size_t size;
+    };
+    std::vector<Block> blocks;
+    size_t block = 0; // block being filled
+    size_t used = 0;  // bytes used in it
+};
+
+// Every distinct string of a snapshot stored once; rows refer to it by id
+struct StringPool {
+    std::pmr::vector<char> chars;
+    std::pmr::vector<uint32_t> offsets; // id -> start of a NUL-terminated string
+
+    explicit StringPool(std::pmr::memory_resource *arena) : chars(arena), offsets(arena) {}
+
+    uint32_t Add(const std::string &str) {
+        offsets.push_back((uint32_t)chars.size());
+        chars.insert(chars.end(), str.c_str(), str.c_str() + str.size() + 1);
+        return (uint32_t)offsets.size() - 1;
+    }
+    const char *Get(uint32_t id) const { return chars.data() + offsets[id]; }
+    void Clear() {
+        chars.clear();
+        offsets.clear();
+    }
+};
+
+// Complete, immutable process list published by the sampler thread.
+// The UI only reads the latest published one and never sees a partial scan.
+// Stored column by column; a process is a row index into every column.
+struct ProcSnapshot {
+    ScanArena arena; // backs every column below, so it is declared first
+
+    std::pmr::vector<int32_t> pid{&arena};
+    std::pmr::vector<int32_t> ppid{&arena};
+    std::pmr::vector<float> cpu{&arena};         // %, normalized per cpuMode
+    std::pmr::vector<float> mem{&arena};         // VmRSS in KB
+    std::pmr::vector<int32_t> threads{&arena};
+    std::pmr::vector<uint32_t> name_id{&arena};  // ids into strings
+    std::pmr::vector<uint32_t> user_id{&arena};
+    std::pmr::vector<uint32_t> command_id{&arena};
+    std::pmr::vector<uint64_t> start_time{&arena}; // clock ticks after boot
+    std::pmr::vector<float> io_read{&arena};        // bytes/s from storage, -1 = not readable
+    std::pmr::vector<float> io_write{&arena};
+    std::pmr::vector<float> io_syscr{&arena};       // read syscalls/s, -1 = not readable
+    std::pmr::vector<float> io_syscw{&arena};
+    std::pmr::vector<float> minflt{&arena}; // page faults/s
+    std::pmr::vector<float> majflt{&arena};
+    std::pmr::vector<float> vcsw{&arena};   // context switches/s
+    std::pmr::vector<float> nvcsw{&arena};
+
+    // Totals over the row and all its descendants
+    std::pmr::vector<float> subtree_cpu{&arena};
+    std::pmr::vector<float> subtree_mem{&arena};
+    std::pmr::vector<int32_t> subtree_threads{&arena};
+    StringPool strings{&arena};
+
+    // Children of row i are child_rows[child_begin[i] .. child_begin[i + 1])
+    std::pmr::vector<int32_t> child_begin{&arena};
+    std::pmr::vector<int32_t> child_rows{&arena};
+
+    std::pmr::vector<int32_t> order{&arena}; // rows in sortMode order
+
+    // The whole tree in preorder, siblings in sortMode order. Roots are rows
+    // whose parent is not in the snapshot. For position i, the subtree is
+    // tree_rows[i .. tree_end[i]).
+    std::pmr::vector<int32_t> tree_rows{&arena};
+    std::pmr::vector<int32_t> tree_depth{&arena};
+    std::pmr::vector<int32_t> tree_end{&arena};
+
+    ProcScanStats stats;
+    unsigned long long generation = 0;
+    unsigned long long held_version = 0; // KeepInSnapshot() set it was scanned with
+
+    int Size() const { return (int)pid.size(); }
+    const char *Name(int row) const { return strings.Get(name_id[row]); }
+    const char *User(int row) const { return strings.Get(user_id[row]); }
+    const char *Command(int row) const { return strings.Get(command_id[row]); }
+    void Clear(); // drops every column and rewinds the arena
+    void Reserve(size_t rows);
+};
+
+// Process search, compiled once per query change. Space separated terms
+// must all match; matching ignores case.
+//   word                 name or command contains it, or the PID does
+//   name:x user:x        equals; name~x user~x cmd~x contains
+//   cpu>20 mem<=512      numbers compare with < <= > >= and : or =; mem in MB
+//   majflt>100 nvcsw>1e4 page faults and context switches are per second
+//   -term                negated; a word starting with "--" is searched as is
+// Values with spaces go in double quotes: cmd~"--port 80"
+class ProcFilter {
+public:
+    enum Field {
+        field_any,
+        field_name,
+        field_user,
+        field_cmd,
+        field_pid, // numeric from here on
+        field_ppid,
+        field_cpu,
+        field_mem,
+        field_threads,
+        field_subtree_cpu,
+        field_subtree_mem,
+        field_minflt,
+        field_majflt,
+        field_vcsw,
+        field_nvcsw,
+    };
+
+    bool Compile(const std::string &query); // false on a bad query, see Error()
+    const std::string &Error() const { return error; }
+    // Keeps the rows that match, in order
+    void Apply(const ProcSnapshot &snapshot, const std::pmr::vector<int32_t> &rows,
+               std::vector<int> &out);
+
+private:
+    enum Op { op_contains, op_equals, op_less, op_less_eq, op_greater, op_greater_eq };
+    struct Term {
+        Field field = field_any;
+        Op op = op_contains;
+        bool negate = false;
+        bool digits = false; // plain word that can also match a PID
+        double number = 0.0;
+        std::string text;    // lowercased
+    };
+
+    bool MatchText(size_t term_index, uint32_t id, size_t id_count);
+
+    std::vector<Term> terms;
+    std::string error;
+    std::vector<char> lowered; // the snapshot's string pool, lowercased
+    const uint32_t *snapshot_offsets = nullptr;
+    unsigned long long lowered_generation = 0;
+    std::vector<signed char> text_matches; // term x string id, -1 = not checked yet
+};
+
+// Copy of one process's recent samples, oldest first
+struct ProcHistoryView {
+    int count = 0;
+    float cpu[PROC_HISTORY_SIZE];
+    float mem[PROC_HISTORY_SIZE]; // MB
+    float threads[PROC_HISTORY_SIZE];
+};
+
+// One thread of a process, from /proc/[pid]/task/[tid]/stat
+struct ProcThread {
+    int tid = 0;
+    float cpu = 0.0f; // %, normalized per cpuMode like the process
+    char state = '?';
+    char name[16] = ""; // comm
+};
+
+// Threads of one process as of one scan, busiest first
+struct ProcThreadList {
+    int pid = 0;
+    unsigned long long start_time = 0;
+    std::vector<ProcThread> threads;
+};
+
+// I/O scheduling classes of ioprio_set(2)
+enum IoClass {
+    io_class_none,
+    io_class_realtime,
+    io_class_best_effort,
+    io_class_idle,
+};
+
+// Scheduling settings of a process, as edited from the context menu
+struct ProcControls {
+    cpu_set_t cpus;
+    int nice = 0;
+    int io_class = io_class_best_effort;
+    int io_level = 4; // 0 (highest) to 7, not used by the idle class
+};
+
+// Work done on many processes at once, off the UI thread
+enum ProcBatchAction {
+    batch_signal,
+    batch_affinity,
+    batch_nice,
+    batch_io_class,
+    batch_export,
+};
+
+struct ProcBatch {
+    ProcBatchAction action = batch_signal;
+    std::vector<ProcKey> keys;
+    int sig = 0;           // batch_signal
+    ProcControls controls; // batch_affinity, batch_nice, batch_io_class
+    std::shared_ptr<const ProcSnapshot> snapshot; // batch_export: the rows written
+    std::string path;                             // batch_export
+};
+
+struct ProcBatchProgress {
+    bool running = false;
+    int done = 0; // processes handled so far
+    int total = 0;
+    std::string summary; // outcome of the last finished batch
+};
+
+// Slow-to-read facts about one process, loaded in the background for the
+// detail pane and cached until the process exits
+struct ProcDetails {
+    int pid = 0;
+    unsigned long long start_time = 0;
+    std::string exe;
+    std::string cwd;
+    std::vector<std::string> environ;
+    std::string environ_error;
+    std::vector<std::string> limits; // /proc/[pid]/limits as is
+    int fd_count = -1;               // -1 = not readable
+    std::vector<std::string> cgroups;
+    std::vector<std::pair<std::string, std::string>> namespaces; // name, link target
+
+    struct MapsSummary {
+        size_t mappings = 0;
+        unsigned long long total_kb = 0, file_kb = 0, anon_kb = 0;
+        unsigned long long heap_kb = 0, stack_kb = 0, other_kb = 0;
+        std::vector<std::pair<std::string, unsigned long long>> largest_files; // path, KB
+        std::string error;
+    } maps;
+};
 
 enum SortMode {
     no_sort,
@@ -48,6 +447,28 @@ enum SortMode {
     cpu_desc,
     thread_sort,
     thread_desc,
+    subtree_cpu_sort,
+    subtree_cpu_desc,
+    subtree_mem_sort,
+    subtree_mem_desc,
+    io_read_sort,
+    io_read_desc,
+    io_write_sort,
+    io_write_desc,
+    minflt_sort,
+    minflt_desc,
+    majflt_sort,
+    majflt_desc,
+    vcsw_sort,
+    vcsw_desc,
+    nvcsw_sort,
+    nvcsw_desc,
+};
+
+// How per-process CPU% is normalized: 100% is one core, or all cores together
+enum CpuMode {
+    cpu_per_core,
+    cpu_all_cores,
 };
 
 struct NetStat {
@@ -92,16 +513,13 @@ typedef struct {
         guest, guest_nice;
 } Core_t;
 
-extern SortMode sortMode;
-Process *CreateProcess(unsigned int pid, char *name, float memusage);
+extern std::atomic<SortMode> sortMode;
+extern std::atomic<CpuMode> cpuMode;
+extern std::atomic<int> procScanWorkers;
+extern std::atomic<int> procTopN; // 0 = keep every process
+extern std::atomic<unsigned long long> procEventOnly;
 void ShowDockSpace(bool &p_open);
-bool IsNumeric(std::string dir_name);
-std::string GetProcName(const char *path);
-int GetMemoryUsage(const char *path);
-std::string GetProcUser(const char *path);
-std::string GetProcCommand(const char *path);
-float GetProcCpuUsage(const std::string &pid);
-int GetProcThreadCount(const char *path);
+float GetProcCpuUsage(ProcEntry &entry, double uptime_secs);
 void ReadMemInfo();
 void FetchProcesses();
 void ShowProcesses();
@@ -110,9 +528,21 @@ void GetNetworkUsage(const std::string &iface);
 void ShowNetworkUsage(float height);
 void GetCpuUsage();
 void ShowCpuUsage();
+bool ShowCorePicker(cpu_set_t &cpus);
 void ShowDiskWindow();
-void KillProc(std::string proc_pid);
-void SortProcesses(SortMode mode);
+void KillProc(int pid, unsigned long long start_time);
+void CleanupPinned(const ProcSnapshot &snapshot);
+void WatchProcesses(const std::vector<ProcKey> &keys);
+bool DrainExitedProcesses(std::vector<ProcKey> &out);
+bool SignalProcess(int pid, unsigned long long start_time, int sig);
+bool GetProcControls(int pid, ProcControls &out);
+bool StartProcBatch(ProcBatch batch);
+void GetProcBatchProgress(ProcBatchProgress &out);
+void SortProcesses(const ProcSnapshot &snapshot, const SortMode *keys, int key_count,
+                   std::pmr::vector<int32_t> &order);
+void LayOutTree(const std::pmr::vector<int32_t> &child_begin, const std::pmr::vector<int32_t> &children,
+                const std::pmr::vector<int32_t> &roots, std::pmr::vector<int32_t> &rows,
+                std::pmr::vector<int32_t> &depth, std::pmr::vector<int32_t> &end);
 void FetchMemoryUsage();
 void ShowMemoryUsage(float height);
 void FetchDiskUsage();
@@ -122,5 +552,22 @@ void ShowSystemInfo(const SystemInfo &info);
 void FetchCpuUsageForPlot();
 void ShowCpuPlot(float height);
 void ShowProcessesTree();
-std::string GetProcPpid(const char* path);
-void ShowProcessNode(int idx);
+bool ShowProcessNode(const ProcSnapshot &snapshot, int pos, int index, bool expanded);
+std::shared_ptr<const ProcSnapshot> GetProcSnapshot();
+unsigned long long KeepInSnapshot(const std::vector<ProcKey> &keys);
+void RecordProcHistory(const ProcSnapshot &snapshot);
+bool GetProcHistory(int pid, unsigned long long start_time, ProcHistoryView &out);
+size_t ProcHistoryBytes();
+void ShowSparkline(const char *id, const float *values, int count, float max_value,
+                   const ImVec4 &color, const ImVec2 &size);
+void ShowProcHistoryPlot(const ProcHistoryView &history, float height);
+void ShowProcessDetails();
+void SampleProcMemory(const ProcSnapshot &snapshot, ProcReader &reader);
+bool GetProcMemory(int pid, unsigned long long start_time, ProcMemory &out);
+void SampleProcThreads(const ProcSnapshot &snapshot, ProcReader &reader);
+std::shared_ptr<const ProcThreadList> GetProcThreads(int pid, unsigned long long start_time);
+std::shared_ptr<const ProcDetails> GetProcDetails(int pid, unsigned long long start_time);
+void PruneProcDetails(const ProcSnapshot &snapshot);
+void ShowProcDetails(const ProcDetails &details);
+bool StartProcEvents();
+bool DrainProcEvents(std::vector<ProcEntry> &captured, bool &missed_events);
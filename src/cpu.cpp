@@ -5,7 +5,9 @@
 #define BUFFER_SIZE 256
 #include "system.h"
 
-static std::vector<float> cpu_usage_list;
+// Written by GetCpuUsage on its own thread; the UI reads copies
+static std::mutex cpu_usage_mtx;
+static std::vector<float> shared_cpu_usage;
 std::atomic<bool> is_finished{false};
 std::atomic<bool> fetch_finished = false;
 static void ReadCpuModel();
@@ -25,6 +27,11 @@ static unsigned long long TotalTime(const Core_t *ct) {
          ct->softirq + ct->steal;
 }
 
+static std::vector<float> CopyCpuUsage() {
+  std::lock_guard<std::mutex> lock(cpu_usage_mtx);
+  return shared_cpu_usage;
+}
+
 float Normalize(float value) {
   float t = (value - 1.0f) / (100.0f - 1.0f);
   // optional clamp
@@ -80,6 +87,7 @@ std::vector<float> CalculateCpuUsage(const std::vector<Core_t> &prev,
 }
 
 void ShowCpuUsage() {
+  const std::vector<float> cpu_usage_list = CopyCpuUsage();
   if (cpu_usage_list.empty())
     return;
 
@@ -132,6 +140,35 @@ void ShowCpuUsage() {
   ImGui::EndChild();
 }
 
+// The per-core list above as checkboxes, for picking an affinity mask.
+// Returns true when a box was toggled.
+bool ShowCorePicker(cpu_set_t &cpus) {
+  bool changed = false;
+  const std::vector<float> cpu_usage_list = CopyCpuUsage();
+  int cores = cpu_usage_list.empty() ? (int)sysconf(_SC_NPROCESSORS_ONLN)
+                                     : (int)cpu_usage_list.size() - 1;
+  for (int core = 0; core < cores && core < CPU_SETSIZE; ++core) {
+    bool on = CPU_ISSET(core, &cpus);
+    char label[16];
+    snprintf(label, sizeof(label), "Core %d", core);
+    if (ImGui::Checkbox(label, &on)) {
+      if (on)
+        CPU_SET(core, &cpus);
+      else
+        CPU_CLR(core, &cpus);
+      changed = true;
+    }
+    if (core + 1 < (int)cpu_usage_list.size()) {
+      float usage = cpu_usage_list[core + 1];
+      ImGui::SameLine();
+      ImGui::ProgressBar(Normalize(usage), ImVec2(80.0f, 0.0f), "");
+      ImGui::SameLine();
+      ImGui::Text("%.1f%%", usage);
+    }
+  }
+  return changed;
+}
+
 void GetCpuUsage() {
   using clock = std::chrono::steady_clock;
   auto last_time = clock::now();
@@ -147,11 +184,14 @@ void GetCpuUsage() {
     auto prev = ReadCpuStatusFile();
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
     auto curr = ReadCpuStatusFile();
-    cpu_usage_list = CalculateCpuUsage(prev, curr);
-    if (!cpu_usage_list.empty()) {
-      System::s_CpuUsage = cpu_usage_list[0];
-      System::s_CpuCore.assign(cpu_usage_list.begin() + 1,
-                               cpu_usage_list.end());
+    std::vector<float> usage = CalculateCpuUsage(prev, curr);
+    if (!usage.empty()) {
+      System::s_CpuUsage = usage[0];
+      System::s_CpuCore.assign(usage.begin() + 1, usage.end());
+    }
+    {
+      std::lock_guard<std::mutex> lock(cpu_usage_mtx);
+      shared_cpu_usage = std::move(usage);
     }
     fetch_finished.store(true, std::memory_order_release);
   }
@@ -71,6 +71,10 @@ void ShowDockSpace(bool& p_open){
         // control refresh speed
         ImGui::SliderFloat("Reading Interval (sec)", reinterpret_cast<float*>(&read_speed),
                            0.2f, 5.0f, "%.1fs");
+        // threads used by the process scan, applied on the next scan
+        int scan_workers = procScanWorkers;
+        if (ImGui::SliderInt("Process Scan Workers", &scan_workers, 1, MAX_SCAN_WORKERS))
+            procScanWorkers = scan_workers;
 
         ImVec2 region = ImGui::GetContentRegionAvail();
         float split_ratio   = 0.5f;
@@ -137,8 +141,16 @@ void ShowDockSpace(bool& p_open){
             "mem_sort", "mem_desc",
             "cpu_sort", "cpu_desc",
             "thread_sort", "thread_desc",
+            "subtree_cpu_sort", "subtree_cpu_desc",
+            "subtree_mem_sort", "subtree_mem_desc",
+            "io_read_sort", "io_read_desc",
+            "io_write_sort", "io_write_desc",
+            "minflt_sort", "minflt_desc",
+            "majflt_sort", "majflt_desc",
+            "vcsw_sort", "vcsw_desc",
+            "nvcsw_sort", "nvcsw_desc",
         };
-        static int currentItem = 1; // Default is "no_sort"
+        int currentItem = sortMode;
         // Dropdown
         ImGui::SetNextItemWidth(120.0f);
         if (ImGui::Combo("##SortBy", &currentItem, sortItems, IM_ARRAYSIZE(sortItems))) {
@@ -147,6 +159,24 @@ void ShowDockSpace(bool& p_open){
         ImGui::SameLine();
         ImGui::Text("Sort");
 
+        // CPU% normalization
+        const char* cpuModeItems[] = { "100% = 1 core", "100% = all cores" };
+        static int cpuModeItem = cpu_per_core;
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(140.0f);
+        if (ImGui::Combo("##CpuMode", &cpuModeItem, cpuModeItems, IM_ARRAYSIZE(cpuModeItems))) {
+            cpuMode = static_cast<CpuMode>(cpuModeItem);
+        }
+
+        // Top-N: only the heaviest processes for the usage sorts
+        int topN = procTopN;
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(90.0f);
+        if (ImGui::InputInt("Top N", &topN, 50, 500)) {
+            procTopN = std::max(0, topN);
+        }
+        ImGui::SetItemTooltip("0 = all processes. Applies to the cpu, mem, thread, io, fault and context switch *_sort modes.");
+
         // Toggle button (tree / flat)
         static bool showTreeMode = false;
         ImGui::SameLine();
@@ -155,10 +185,10 @@ void ShowDockSpace(bool& p_open){
         }
 
         // Search Bar
-        static char searchBuffer[64] = "";
+        static char searchBuffer[256] = "";
         ImGui::SameLine();
-        ImGui::SetNextItemWidth(200.0f); 
-        if (ImGui::InputTextWithHint("##Search", "Search process...", searchBuffer, IM_ARRAYSIZE(searchBuffer))) {
+        ImGui::SetNextItemWidth(260.0f);
+        if (ImGui::InputTextWithHint("##Search", "Search, e.g. cpu>20 user:postgres cmd~\"--port\"", searchBuffer, IM_ARRAYSIZE(searchBuffer))) {
             search_query = searchBuffer;
         }
         // Show either flat or tree
@@ -166,6 +196,7 @@ void ShowDockSpace(bool& p_open){
             ShowProcessesTree();
         else
             ShowProcessesV();
+        ShowProcessDetails();
         ImGui::EndChild();
         // Bottom container 
         ImGui::BeginChild("ProcBottom", ImVec2(region.x, bottom_height), false);
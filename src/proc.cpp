@@ -2,111 +2,686 @@
 #include <algorithm>
 #include <cstdlib>
 #include <cstring>
-#include <filesystem>
+#include <ctime>
 #include <iostream>
 #include <numeric>
 #include <signal.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <unordered_map>
-#include <unordered_set>
 
-namespace fs = std::filesystem;
-static const fs::path dir_path = "/proc/";
-static std::vector<Process> Procs;
-static std::mutex mtx;
-static std::string selected_pid;
+static int selected_pid = 0; // 0 = nothing selected; the one whose details show
 static int current_match_index;
-SortMode sortMode = no_sort;
+std::atomic<SortMode> sortMode{no_sort};
+std::atomic<CpuMode> cpuMode{cpu_per_core};
 std::string search_query;
-static std::unordered_set<std::string> pinned_pids;
+static std::unordered_map<int, unsigned long long> pinned_pids; // pid -> start time
+
+// Tree view: expand state, pid -> start time, and the visible tree positions
+// built from it
+static std::unordered_map<int, unsigned long long> expanded_pids;
+static std::vector<int> tree_visible;
+static unsigned long long tree_visible_generation = 0;
+static bool tree_visible_dirty = true;
+
+// Tree view: the snapshot's preorder, laid out again with siblings in header
+// order while a header column sorts. Indexed like ProcSnapshot::tree_rows.
+static std::vector<SortMode> tree_sort_keys;
+static std::pmr::vector<int32_t> sorted_tree_rows;
+static std::pmr::vector<int32_t> sorted_tree_depth;
+static std::pmr::vector<int32_t> sorted_tree_end;
+static bool tree_sort_dirty = true;
+
+// Sort modes for a header click, {ascending, descending}. Sortable columns
+// pass their index in here as the column user ID.
+enum SortColumn {
+    sort_pid,
+    sort_name,
+    sort_cpu,
+    sort_mem,
+    sort_threads,
+    sort_subtree_cpu,
+    sort_subtree_mem,
+    sort_io_read,
+    sort_io_write,
+    sort_minflt,
+    sort_majflt,
+    sort_vcsw,
+    sort_nvcsw,
+};
+static const SortMode column_sort_modes[][2] = {
+    {pid_sort, pid_desc},       {name_sort, name_desc},
+    {cpu_desc, cpu_sort},       {mem_desc, mem_sort},
+    {thread_desc, thread_sort}, {subtree_cpu_desc, subtree_cpu_sort},
+    {subtree_mem_desc, subtree_mem_sort},
+    {io_read_desc, io_read_sort},
+    {io_write_desc, io_write_sort},
+    {minflt_desc, minflt_sort}, {majflt_desc, majflt_sort},
+    {vcsw_desc, vcsw_sort},     {nvcsw_desc, nvcsw_sort},
+};
+
+// Flat view: header sort keys, most significant first, and the rows sorted
+// by them. Reused across frames until the snapshot or the keys change.
+static std::vector<SortMode> flat_sort_keys;
+static std::pmr::vector<int32_t> flat_sorted_rows;
+static unsigned long long flat_sorted_generation = 0;
+static bool flat_sort_dirty = false;
+static bool scroll_to_selected = false;
+
+// Flat view: what the table shows, cached with what it was built from
+static ProcFilter filter;
+static std::string filter_query;
+static std::string filter_error;
+static std::vector<int> flat_rows;
+static int flat_pinned_count = 0;
+static unsigned long long flat_rows_generation = 0;
+static bool flat_rows_dirty = true;
+
+// Flat view: processes with their threads listed under them. Threads are
+// sampled for those and for the pinned ones, so a pinned process already
+// has a CPU baseline when it is expanded.
+static std::unordered_map<int, unsigned long long> thread_pids; // pid -> start time
+static std::vector<int> flat_thread_rows; // rows whose threads are sampled
+static std::unordered_map<int, std::shared_ptr<const ProcThreadList>> flat_threads; // shown ones
+
+// What the flat table draws, one entry per line
+struct FlatItem {
+    int row;
+    int thread; // index into the row's thread list; -1 = the process, -2 = no list yet
+};
+static std::vector<FlatItem> flat_items;
+static int flat_pinned_items = 0; // pinned processes and their threads, first in flat_items
+
+// Pinned and expanded processes are held by pidfd (procwatch.cpp); the ones
+// that exited show as such until a scan drops them. pid -> start time.
+static std::unordered_map<int, unsigned long long> exited_pids;
+
+// pid -> start time sets: a PID that got recycled is a different process
+static void EraseProcKey(std::unordered_map<int, unsigned long long> &pids, const ProcKey &key) {
+    auto it = pids.find(key.pid);
+    if (it != pids.end() && it->second == key.start_time)
+        pids.erase(it);
+}
+
+static bool HasProcKey(const std::unordered_map<int, unsigned long long> &pids, int pid,
+                       unsigned long long start_time) {
+    auto it = pids.find(pid);
+    return it != pids.end() && it->second == start_time;
+}
+
+static void DropGone(std::unordered_map<int, unsigned long long> &pids,
+                     const std::unordered_map<int, unsigned long long> &valid) {
+    for (auto it = pids.begin(); it != pids.end();) {
+        auto live = valid.find(it->first);
+        if (live == valid.end() || live->second != it->second)
+            it = pids.erase(it);
+        else
+            ++it;
+    }
+}
+
+// Context menu editors for affinity, nice and I/O class, loaded from the
+// process the menu was last opened on
+static ProcControls control_edit;
+static int control_pid = 0;
+static bool control_subtree = false;
+
+// Selected processes by PID, shared by both views; ctrl/shift-click and
+// box-select add to it. Batch actions from a selected row's context menu
+// go to all of them, on the batch worker (proccontrol.cpp).
+static ImGuiSelectionBasicStorage proc_selection;
+static std::unordered_map<int, unsigned long long> selected_keys; // pid -> start time, when picked
+static int clicked_pid = 0; // clicked this frame, becomes selected_pid
+static ProcBatchProgress batch_progress; // refreshed once a frame
+static unsigned long long held_version = 0; // of the last KeepInSnapshot() call
+
+// After a frame's requests: records the start time of newly selected
+// processes, and keeps selected_pid within the selection (the row clicked
+// last if it got selected, otherwise any selected one)
+static void SyncSelectedPid(const ProcSnapshot &procs) {
+    for (auto it = selected_keys.begin(); it != selected_keys.end();)
+        if (!proc_selection.Contains(it->first))
+            it = selected_keys.erase(it);
+        else
+            ++it;
+    if ((int)selected_keys.size() < proc_selection.Size)
+        for (int row = 0; row < procs.Size(); row++)
+            if (proc_selection.Contains(procs.pid[row]))
+                selected_keys.try_emplace(procs.pid[row], procs.start_time[row]);
+
+    if (clicked_pid != 0 && proc_selection.Contains(clicked_pid))
+        selected_pid = clicked_pid;
+    clicked_pid = 0;
+    if (proc_selection.Contains(selected_pid))
+        return;
+    void *it = nullptr;
+    ImGuiID id = 0;
+    selected_pid = proc_selection.GetNextSelectedItem(&it, &id) ? (int)id : 0;
+}
+
+// Pinned, expanded and selected processes, for the sampler to keep as rows
+// of a top-N snapshot. Only sent when the set changed.
+static void PublishHeld() {
+    static std::vector<ProcKey> held, published;
+    held.clear();
+    for (const auto *pids : {&pinned_pids, &thread_pids, &selected_keys})
+        for (const auto &[pid, start_time] : *pids)
+            held.push_back({pid, start_time});
+    std::sort(held.begin(), held.end(), [](const ProcKey &a, const ProcKey &b) {
+        return a.pid != b.pid ? a.pid < b.pid : a.start_time < b.start_time;
+    });
+    held.erase(std::unique(held.begin(), held.end()), held.end());
+    if (held != published) {
+        held_version = KeepInSnapshot(held);
+        published.swap(held);
+    }
+}
+
+// Keys of the selected processes, with subtrees also of everything under
+// them. In tree order, so a subtree inside another isn't listed twice.
+static void SelectedKeys(const ProcSnapshot &procs, bool subtrees, std::vector<ProcKey> &keys) {
+    keys.clear();
+    for (int pos = 0; pos < (int)procs.tree_rows.size();) {
+        int row = procs.tree_rows[pos];
+        auto selected = selected_keys.find(procs.pid[row]);
+        if (selected == selected_keys.end() || selected->second != procs.start_time[row]) {
+            pos++;
+            continue;
+        }
+        int end = subtrees ? procs.tree_end[pos] : pos + 1;
+        for (; pos < end; pos++)
+            keys.push_back({procs.pid[procs.tree_rows[pos]], procs.start_time[procs.tree_rows[pos]]});
+    }
+}
+
+// Whether a context menu opened on this row acts on the whole selection
+static bool MenuOnSelection(int pid) {
+    return proc_selection.Size > 1 && proc_selection.Contains(pid);
+}
+
+static SortMode HeaderSortMode(const ImGuiTableColumnSortSpecs &spec) {
+    if (spec.ColumnUserID >= IM_ARRAYSIZE(column_sort_modes))
+        return no_sort;
+    bool descending = spec.SortDirection == ImGuiSortDirection_Descending;
+    return column_sort_modes[spec.ColumnUserID][descending];
+}
+
+// "12.3M" style bytes per second for the IO columns
+static void FormatRate(char *out, size_t size, float bytes_per_sec) {
+    const char *units = "BKMGT";
+    int unit = 0;
+    while (bytes_per_sec >= 1024.0f && unit < 4) {
+        bytes_per_sec /= 1024.0f;
+        unit++;
+    }
+    if (unit == 0)
+        snprintf(out, size, "%.0f", bytes_per_sec);
+    else
+        snprintf(out, size, "%.1f%c", bytes_per_sec, units[unit]);
+}
+
+// One IO rate cell: "-" when the process's io file can't be read (EACCES
+// for other users' processes unless we are root)
+static void ShowIoRate(float bytes_per_sec, float syscalls_per_sec, const char *what) {
+    if (bytes_per_sec < 0.0f) {
+        ImGui::TextDisabled("-");
+        ImGui::SetItemTooltip("/proc/[pid]/io is not readable");
+        return;
+    }
+    char rate[16];
+    FormatRate(rate, sizeof(rate), bytes_per_sec);
+    if (bytes_per_sec > 0.0f)
+        ImGui::TextUnformatted(rate);
+    else
+        ImGui::TextDisabled("%s", rate);
+    ImGui::SetItemTooltip("%.0f %s syscalls/s", syscalls_per_sec, what);
+}
+
+// Affinity, nice and I/O class entries of a row's context menu. A change
+// goes to the row, or to every selected process if the row is one of
+// them; with "Apply to Subtree" on, descendants are included.
+static void ShowProcControlMenu(const ProcSnapshot &procs, int row) {
+    int pid = procs.pid[row];
+    if (control_pid != pid) {
+        control_edit = ProcControls{};
+        if (!GetProcControls(pid, control_edit)) {
+            CPU_ZERO(&control_edit.cpus);
+            for (int core = 0; core < sysconf(_SC_NPROCESSORS_ONLN) && core < CPU_SETSIZE; core++)
+                CPU_SET(core, &control_edit.cpus);
+        }
+        control_pid = pid;
+    }
+
+    bool busy = batch_progress.running;
+    // A top-N tree holds only the rows kept, so it can't name every descendant
+    bool subtree = control_subtree && !procs.stats.top_n;
+    auto start_batch = [&](ProcBatchAction action) {
+        ProcBatch batch;
+        batch.action = action;
+        batch.controls = control_edit;
+        auto pos = std::find(procs.tree_rows.begin(), procs.tree_rows.end(), row);
+        if (MenuOnSelection(pid)) {
+            SelectedKeys(procs, subtree, batch.keys);
+        } else if (!subtree || pos == procs.tree_rows.end()) {
+            batch.keys.push_back({pid, procs.start_time[row]});
+        } else {
+            int begin = (int)(pos - procs.tree_rows.begin());
+            for (int i = begin; i < procs.tree_end[begin]; i++)
+                batch.keys.push_back({procs.pid[procs.tree_rows[i]], procs.start_time[procs.tree_rows[i]]});
+        }
+        StartProcBatch(std::move(batch));
+        ImGui::CloseCurrentPopup();
+    };
+
+    ImGui::Separator();
+    ImGui::BeginDisabled(procs.stats.top_n > 0);
+    ImGui::MenuItem("Apply to Subtree", nullptr, &control_subtree);
+    ImGui::EndDisabled();
+    if (procs.stats.top_n > 0)
+        ImGui::SetItemTooltip("Not while only the top %d processes are listed", procs.stats.top_n);
+
+    if (ImGui::BeginMenu("Set Affinity")) {
+        ShowCorePicker(control_edit.cpus);
+        if (ImGui::Button("All")) {
+            for (int core = 0; core < sysconf(_SC_NPROCESSORS_ONLN) && core < CPU_SETSIZE; core++)
+                CPU_SET(core, &control_edit.cpus);
+        }
+        ImGui::SameLine();
+        ImGui::BeginDisabled(busy || CPU_COUNT(&control_edit.cpus) == 0);
+        if (ImGui::Button("Apply"))
+            start_batch(batch_affinity);
+        ImGui::EndDisabled();
+        ImGui::EndMenu();
+    }
+
+    if (ImGui::BeginMenu("Renice")) {
+        ImGui::SetNextItemWidth(160.0f);
+        ImGui::SliderInt("nice", &control_edit.nice, -20, 19);
+        ImGui::TextDisabled("Lowering it needs CAP_SYS_NICE");
+        ImGui::BeginDisabled(busy);
+        if (ImGui::Button("Apply"))
+            start_batch(batch_nice);
+        ImGui::EndDisabled();
+        ImGui::EndMenu();
+    }
+
+    if (ImGui::BeginMenu("Set I/O Class")) {
+        ImGui::RadioButton("realtime", &control_edit.io_class, io_class_realtime);
+        ImGui::SameLine();
+        ImGui::RadioButton("best-effort", &control_edit.io_class, io_class_best_effort);
+        ImGui::SameLine();
+        ImGui::RadioButton("idle", &control_edit.io_class, io_class_idle);
+        if (control_edit.io_class != io_class_idle) {
+            ImGui::SetNextItemWidth(160.0f);
+            ImGui::SliderInt("level (0 = highest)", &control_edit.io_level, 0, 7);
+        }
+        if (control_edit.io_class == io_class_realtime)
+            ImGui::TextDisabled("realtime needs CAP_SYS_ADMIN");
+        ImGui::BeginDisabled(busy);
+        if (ImGui::Button("Apply"))
+            start_batch(batch_io_class);
+        ImGui::EndDisabled();
+        ImGui::EndMenu();
+    }
+}
+
+// Batch entries of the context menu of a row in a multi-selection
+static void ShowSelectionMenu(const ProcSnapshot &procs) {
+    ImGui::Separator();
+    ImGui::TextDisabled("%d selected", proc_selection.Size);
+    bool pin = ImGui::MenuItem("Pin Selected");
+    bool unpin = ImGui::MenuItem("Unpin Selected");
+    if (pin || unpin) {
+        for (int row = 0; row < procs.Size(); row++) {
+            if (!proc_selection.Contains(procs.pid[row]))
+                continue;
+            if (pin)
+                pinned_pids[procs.pid[row]] = procs.start_time[row];
+            else
+                EraseProcKey(pinned_pids, {procs.pid[row], procs.start_time[row]});
+        }
+        flat_rows_dirty = true;
+    }
+
+    bool busy = batch_progress.running;
+    static const int signals[] = {SIGTERM, SIGKILL, SIGHUP, SIGINT, SIGSTOP, SIGCONT};
+    static const char *signal_names[] = {"SIGTERM", "SIGKILL", "SIGHUP", "SIGINT", "SIGSTOP", "SIGCONT"};
+    if (ImGui::BeginMenu("Send Signal", !busy)) {
+        for (int i = 0; i < IM_ARRAYSIZE(signals); i++) {
+            if (!ImGui::MenuItem(signal_names[i]))
+                continue;
+            ProcBatch batch;
+            batch.action = batch_signal;
+            batch.sig = signals[i];
+            SelectedKeys(procs, false, batch.keys);
+            StartProcBatch(std::move(batch));
+        }
+        ImGui::EndMenu();
+    }
+
+    if (ImGui::MenuItem("Export as CSV", nullptr, false, !busy)) {
+        ProcBatch batch;
+        batch.action = batch_export;
+        batch.snapshot = GetProcSnapshot();
+        SelectedKeys(*batch.snapshot, false, batch.keys);
+        char path[64];
+        snprintf(path, sizeof(path), "punktop-%ld.csv", (long)time(nullptr));
+        batch.path = path;
+        StartProcBatch(std::move(batch));
+    }
+}
+
+// Selection size and the progress of the running batch, or how the last
+// one went
+static void ShowBatchStatus() {
+    GetProcBatchProgress(batch_progress);
+    if (batch_progress.running) {
+        char overlay[48];
+        snprintf(overlay, sizeof(overlay), "%d / %d processes", batch_progress.done,
+                 batch_progress.total);
+        float fraction = batch_progress.total ? batch_progress.done / (float)batch_progress.total : 0.0f;
+        ImGui::ProgressBar(fraction, ImVec2(-FLT_MIN, 0.0f), overlay);
+    } else if (!batch_progress.summary.empty()) {
+        ImGui::TextDisabled("Last batch, %s", batch_progress.summary.c_str());
+    }
+    if (proc_selection.Size > 1)
+        ImGui::TextDisabled("%d selected, right-click one of them for batch actions",
+                            proc_selection.Size);
+}
 
 void ShowProcessesV() {
     ImGui::BeginChild("ProcScroll", ImVec2(0, 400), true);
 
+    // Hold the snapshot for the whole frame so the sampler can't retire it under us
+    std::shared_ptr<const ProcSnapshot> snapshot = GetProcSnapshot();
+    if (!snapshot) {
+        ImGui::TextDisabled("Loading processes...");
+        ImGui::EndChild();
+        return;
+    }
+    const ProcSnapshot &procs = *snapshot;
+    ImGui::TextDisabled("%zu processes, %llu syscalls, %.1f ms on %d workers per scan",
+                        snapshot->stats.processes, snapshot->stats.syscalls,
+                        snapshot->stats.scan_ms, snapshot->stats.workers);
+    if (snapshot->stats.top_n > 0) {
+        ImGui::SameLine();
+        ImGui::TextDisabled("| top %zu of %zu", snapshot->stats.processes, snapshot->stats.scanned);
+    }
+    ImGui::SameLine();
+    if (snapshot->stats.events)
+        ImGui::TextDisabled("| proc events, %llu seen only via events", snapshot->stats.event_only);
+    else
+        ImGui::TextDisabled("| polling /proc");
+    ImGui::TextDisabled("Arena: %zu allocations, %.1f KB, %zu mallocs this scan",
+                        snapshot->stats.arena_allocations, snapshot->stats.arena_bytes / 1024.0f,
+                        snapshot->stats.arena_mallocs);
+    ShowBatchStatus();
+
     static ImGuiTableFlags flags =
         ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_RowBg |
         ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_Resizable |
         ImGuiTableFlags_ScrollY;
 
-    // Filtered indexes
-    std::vector<int> filtered_indexes;
-    for (int i = 0; i < (int)Procs.size(); i++) {
-        const Process &proc = Procs[i];
-        if (search_query.empty() ||
-            proc.Name.find(search_query) != std::string::npos ||
-            proc.Pid.find(search_query) != std::string::npos ||
-            proc.Command.find(search_query) != std::string::npos) {
-            filtered_indexes.push_back(i);
+    // Without header sort keys the sampler's order is used as is. Otherwise
+    // its order is re-sorted, so ties keep it.
+    const std::pmr::vector<int32_t> *sorted_rows = &procs.order;
+    if (!flat_sort_keys.empty()) {
+        if (flat_sort_dirty || flat_sorted_generation != procs.generation) {
+            flat_sorted_rows.assign(procs.order.begin(), procs.order.end());
+            SortProcesses(procs, flat_sort_keys.data(), (int)flat_sort_keys.size(),
+                          flat_sorted_rows);
+            flat_sorted_generation = procs.generation;
         }
+        sorted_rows = &flat_sorted_rows;
+    }
+    if (flat_sort_dirty) {
+        scroll_to_selected = selected_pid != 0;
+        flat_sort_dirty = false;
+        flat_rows_dirty = true;
     }
 
-    // Split pinned and normal
-    std::vector<int> pinned_indexes, normal_indexes;
-    for (int idx : filtered_indexes) {
-        if (pinned_pids.count(Procs[idx].Pid))
-            pinned_indexes.push_back(idx);
-        else
-            normal_indexes.push_back(idx);
+    // The query is compiled once per edit; a bad one shows all rows
+    if (search_query != filter_query) {
+        filter_query = search_query;
+        filter_error.clear();
+        if (!filter.Compile(filter_query)) {
+            filter_error = filter.Error();
+            filter.Compile("");
+        }
+        flat_rows_dirty = true;
+    }
+    if (!filter_error.empty())
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Search: %s", filter_error.c_str());
+
+    // Held processes report their exit at once, not at the next scan
+    static std::vector<ProcKey> exited;
+    if (DrainExitedProcesses(exited)) {
+        for (const ProcKey &key : exited) {
+            EraseProcKey(pinned_pids, key);
+            EraseProcKey(thread_pids, key);
+            exited_pids[key.pid] = key.start_time;
+        }
+        flat_rows_dirty = true;
+    }
+    if (flat_rows_generation != procs.generation)
+        CleanupPinned(procs);
+
+    // Filtered rows in sort order, pinned ones first. Only rebuilt when the
+    // snapshot, the sort, the query or the pinned set changes.
+    if (flat_rows_dirty || flat_rows_generation != procs.generation) {
+        static std::vector<int> filtered_rows;
+        filter.Apply(procs, *sorted_rows, filtered_rows);
+        flat_rows.clear();
+        flat_pinned_count = 0;
+        if (pinned_pids.empty()) {
+            flat_rows.swap(filtered_rows);
+        } else {
+            for (int row : filtered_rows)
+                if (HasProcKey(pinned_pids, procs.pid[row], procs.start_time[row]))
+                    flat_rows.push_back(row);
+            flat_pinned_count = (int)flat_rows.size();
+            for (int row : filtered_rows)
+                if (!HasProcKey(pinned_pids, procs.pid[row], procs.start_time[row]))
+                    flat_rows.push_back(row);
+        }
+        flat_thread_rows.assign(flat_rows.begin(), flat_rows.begin() + flat_pinned_count);
+        if (!thread_pids.empty())
+            for (size_t i = flat_pinned_count; i < flat_rows.size(); i++)
+                if (HasProcKey(thread_pids, procs.pid[flat_rows[i]], procs.start_time[flat_rows[i]]))
+                    flat_thread_rows.push_back(flat_rows[i]);
+        flat_threads.clear();
+        flat_items.clear();
+        flat_pinned_items = 0;
+
+        // Hold every pinned or expanded process by pidfd, pinned ones first
+        static std::vector<ProcKey> held;
+        held.clear();
+        for (const auto &[pid, start_time] : pinned_pids)
+            held.push_back({pid, start_time});
+        for (const auto &[pid, start_time] : thread_pids)
+            if (!HasProcKey(pinned_pids, pid, start_time))
+                held.push_back({pid, start_time});
+        WatchProcesses(held);
+
+        flat_rows_generation = procs.generation;
+        flat_rows_dirty = false;
     }
 
-    if (ImGui::BeginTable("ProcTable", 7, flags)) {
-        ImGui::TableSetupScrollFreeze(0, 1);
-        ImGui::TableSetupColumn("PID", ImGuiTableColumnFlags_WidthFixed, 60.0f);
-        ImGui::TableSetupColumn("User", ImGuiTableColumnFlags_WidthFixed, 80.0f);
-        ImGui::TableSetupColumn("Name");
-        ImGui::TableSetupColumn("%CPU", ImGuiTableColumnFlags_WidthFixed, 60.0f);
-        ImGui::TableSetupColumn("Mem (MB)", ImGuiTableColumnFlags_WidthFixed, 80.0f);
-        ImGui::TableSetupColumn("Threads", ImGuiTableColumnFlags_WidthFixed, 60.0f);
-        ImGui::TableSetupColumn("Command");
+    // Thread lists come from the sampler a scan later than the rows, so
+    // the lines are rebuilt whenever a shown list changes
+    bool items_dirty = flat_items.empty() && !flat_rows.empty();
+    for (int row : flat_thread_rows) {
+        int pid = procs.pid[row];
+        std::shared_ptr<const ProcThreadList> threads = GetProcThreads(pid, procs.start_time[row]);
+        if (!HasProcKey(thread_pids, pid, procs.start_time[row]))
+            continue;
+        std::shared_ptr<const ProcThreadList> &shown = flat_threads[pid];
+        if (shown != threads) {
+            shown = std::move(threads);
+            items_dirty = true;
+        }
+    }
+    if (items_dirty) {
+        flat_items.clear();
+        flat_pinned_items = 0;
+        for (size_t i = 0; i < flat_rows.size(); i++) {
+            int row = flat_rows[i];
+            flat_items.push_back({row, -1});
+            if (!thread_pids.empty() && HasProcKey(thread_pids, procs.pid[row], procs.start_time[row])) {
+                auto it = flat_threads.find(procs.pid[row]);
+                if (it == flat_threads.end() || !it->second)
+                    flat_items.push_back({row, -2});
+                else
+                    for (size_t t = 0; t < it->second->threads.size(); t++)
+                        flat_items.push_back({row, (int)t});
+            }
+            if ((int)i + 1 == flat_pinned_count)
+                flat_pinned_items = (int)flat_items.size();
+        }
+    }
+    const std::vector<FlatItem> &items = flat_items;
+    int pinned_count = flat_pinned_items;
+
+    // Pinned rows stay on screen under the header; past the cap they scroll
+    int frozen_count = std::min(pinned_count, MAX_FROZEN_PINNED);
+
+    // Fault, context switch and PSS/USS/Swap columns are off by default;
+    // right-click the header to show them
+    if (ImGui::BeginTable("ProcTable", 17, flags | ImGuiTableFlags_Sortable |
+                                              ImGuiTableFlags_SortMulti |
+                                              ImGuiTableFlags_SortTristate |
+                                              ImGuiTableFlags_Hideable)) {
+        ImGuiTableColumnFlags fixed = ImGuiTableColumnFlags_WidthFixed;
+        ImGuiTableColumnFlags no_sort_col = ImGuiTableColumnFlags_NoSort;
+        ImGuiTableColumnFlags optional = ImGuiTableColumnFlags_DefaultHide;
+        ImGui::TableSetupScrollFreeze(0, 1 + frozen_count);
+        ImGui::TableSetupColumn("PID", fixed, 60.0f, sort_pid);
+        ImGui::TableSetupColumn("User", fixed | no_sort_col, 80.0f);
+        ImGui::TableSetupColumn("Name", 0, 0.0f, sort_name);
+        ImGui::TableSetupColumn("%CPU", fixed, 60.0f, sort_cpu);
+        ImGui::TableSetupColumn("Mem (MB)", fixed, 80.0f, sort_mem);
+        ImGui::TableSetupColumn("Threads", fixed, 60.0f, sort_threads);
+        ImGui::TableSetupColumn("IO R/s", fixed, 60.0f, sort_io_read);
+        ImGui::TableSetupColumn("IO W/s", fixed, 60.0f, sort_io_write);
+        ImGui::TableSetupColumn("MinFlt/s", fixed | optional, 70.0f, sort_minflt);
+        ImGui::TableSetupColumn("MajFlt/s", fixed | optional, 70.0f, sort_majflt);
+        ImGui::TableSetupColumn("VCSW/s", fixed | optional, 70.0f, sort_vcsw);
+        ImGui::TableSetupColumn("NVCSW/s", fixed | optional, 70.0f, sort_nvcsw);
+        ImGui::TableSetupColumn("PSS (MB)", fixed | no_sort_col | optional, 70.0f);
+        ImGui::TableSetupColumn("USS (MB)", fixed | no_sort_col | optional, 70.0f);
+        ImGui::TableSetupColumn("Swap (MB)", fixed | no_sort_col | optional, 70.0f);
+        ImGui::TableSetupColumn("CPU History", fixed | no_sort_col, 100.0f);
+        ImGui::TableSetupColumn("Command", no_sort_col);
         ImGui::TableHeadersRow();
 
-        auto render_row = [&](int i) {
-            const Process &proc = Procs[i];
-            bool is_selected = (proc.Pid == selected_pid);
-            bool is_pinned = pinned_pids.count(proc.Pid);
+        // smaps_rollup is only read while one of its columns is shown, and
+        // only for the rows drawn plus the pinned ones
+        const int first_memory_column = 12; // PSS, USS, Swap
+        bool show_memory = false;
+        for (int column = first_memory_column; column < first_memory_column + 3; column++)
+            show_memory |= (ImGui::TableGetColumnFlags(column) & ImGuiTableColumnFlags_IsEnabled) != 0;
+        static ProcMemory memory;
+        if (show_memory)
+            for (int i = frozen_count; i < pinned_count; i++)
+                if (items[i].thread == -1)
+                    GetProcMemory(procs.pid[items[i].row], procs.start_time[items[i].row], memory);
+
+        // Shift-click adds columns; the new order is used from the next frame
+        ImGuiTableSortSpecs *sort_specs = ImGui::TableGetSortSpecs();
+        if (sort_specs && sort_specs->SpecsDirty) {
+            flat_sort_keys.clear();
+            for (int i = 0; i < sort_specs->SpecsCount; i++)
+                flat_sort_keys.push_back(HeaderSortMode(sort_specs->Specs[i]));
+            flat_sort_dirty = true;
+            sort_specs->SpecsDirty = false;
+        }
+
+        // Keep the selected process in view after a re-sort
+        if (scroll_to_selected) {
+            for (int i = frozen_count; i < (int)items.size(); i++) {
+                if (items[i].thread != -1 || procs.pid[items[i].row] != selected_pid)
+                    continue;
+                float row_height = ImGui::GetTextLineHeight() + ImGui::GetStyle().CellPadding.y * 2.0f;
+                ImGui::SetScrollY(std::max(0.0f, (i - frozen_count) * row_height -
+                                                     ImGui::GetWindowHeight() * 0.5f));
+                break;
+            }
+            scroll_to_selected = false;
+        }
+
+        auto render_row = [&](int row, int index) {
+            int pid = procs.pid[row];
+            bool is_selected = proc_selection.Contains(pid);
+            bool is_pinned = HasProcKey(pinned_pids, pid, procs.start_time[row]);
 
             ImGui::TableNextRow();
-            ImGui::PushID(i);
+            ImGui::PushID(pid);
             ImGui::TableNextColumn();
 
-            if (ImGui::Selectable(proc.Pid.c_str(), is_selected,
+            char pid_label[16];
+            snprintf(pid_label, sizeof(pid_label), "%d", pid);
+            ImGui::SetNextItemSelectionUserData(index);
+            if (ImGui::Selectable(pid_label, is_selected,
                                   ImGuiSelectableFlags_SpanAllColumns)) {
-                selected_pid = (is_selected ? "" : proc.Pid);
+                clicked_pid = pid;
             }
 
             // Context menu
             if (ImGui::BeginPopupContextItem()) {
                 if (ImGui::MenuItem(is_pinned ? "Unpin Process" : "Pin Process")) {
                     if (is_pinned)
-                        pinned_pids.erase(proc.Pid);
+                        pinned_pids.erase(pid);
+                    else
+                        pinned_pids[pid] = procs.start_time[row];
+                    flat_rows_dirty = true;
+                }
+                bool threads_shown = HasProcKey(thread_pids, pid, procs.start_time[row]);
+                char threads_label[32];
+                snprintf(threads_label, sizeof(threads_label), "%s Threads (%d)",
+                         threads_shown ? "Hide" : "Show", procs.threads[row]);
+                if (ImGui::MenuItem(threads_label)) {
+                    if (threads_shown)
+                        thread_pids.erase(pid);
                     else
-                        pinned_pids.insert(proc.Pid);
+                        thread_pids[pid] = procs.start_time[row];
+                    flat_rows_dirty = true;
+                }
+                if (ImGui::MenuItem("Show Details")) {
+                    proc_selection.Clear();
+                    proc_selection.SetItemSelected(pid, true);
+                    selected_pid = pid;
                 }
                 if (ImGui::MenuItem("Kill Process")) {
-                    KillProc(proc.Pid);
+                    KillProc(pid, procs.start_time[row]);
                 }
+                if (MenuOnSelection(pid))
+                    ShowSelectionMenu(procs);
+                ShowProcControlMenu(procs, row);
                 ImGui::EndPopup();
             }
 
             ImGui::TableNextColumn();
-            ImGui::TextUnformatted(proc.User.c_str());
+            ImGui::TextUnformatted(procs.User(row));
 
             ImGui::TableNextColumn();
-            if (is_pinned)
-                ImGui::TextColored(ImVec4(0.7f, 0.8f, 1.0f, 1.0f), "📌 %s", proc.Name.c_str());
+            auto gone = exited_pids.find(pid);
+            if (gone != exited_pids.end() && gone->second == procs.start_time[row])
+                ImGui::TextDisabled("%s (exited)", procs.Name(row));
+            else if (is_pinned)
+                ImGui::TextColored(ImVec4(0.7f, 0.8f, 1.0f, 1.0f), "📌 %s", procs.Name(row));
             else
-                ImGui::TextUnformatted(proc.Name.c_str());
+                ImGui::TextUnformatted(procs.Name(row));
 
             ImGui::TableNextColumn();
+            float cpu = procs.cpu[row];
             ImVec4 cpu_color =
-                (proc.CpuUsage > 50.0f) ? ImVec4(1, 0.3f, 0.3f, 1)
-                : (proc.CpuUsage > 20.0f) ? ImVec4(1, 1, 0, 1)
-                                          : ImVec4(0.3f, 1, 0.3f, 1);
-            ImGui::TextColored(cpu_color, "%.1f", proc.CpuUsage);
+                (cpu > 50.0f) ? ImVec4(1, 0.3f, 0.3f, 1)
+                : (cpu > 20.0f) ? ImVec4(1, 1, 0, 1)
+                                : ImVec4(0.3f, 1, 0.3f, 1);
+            ImGui::TextColored(cpu_color, "%.1f", cpu);
 
             ImGui::TableNextColumn();
-            float memMB = proc.MemUsage / 1024.0f;
+            float memMB = procs.mem[row] / 1024.0f;
             ImVec4 mem_color =
                 (memMB > 200) ? ImVec4(1, 0.3f, 0.3f, 1)
                 : (memMB > 100) ? ImVec4(1, 1, 0, 1)
@@ -114,22 +689,110 @@ void ShowProcessesV() {
             ImGui::TextColored(mem_color, "%.1f", memMB);
 
             ImGui::TableNextColumn();
-            ImGui::Text("%d", proc.ThreadCount);
+            ImGui::Text("%d", procs.threads[row]);
+
+            ImGui::TableNextColumn();
+            ShowIoRate(procs.io_read[row], procs.io_syscr[row], "read");
+            ImGui::TableNextColumn();
+            ShowIoRate(procs.io_write[row], procs.io_syscw[row], "write");
+
+            const float counter_rates[] = {procs.minflt[row], procs.majflt[row], procs.vcsw[row],
+                                           procs.nvcsw[row]};
+            for (float per_sec : counter_rates) {
+                ImGui::TableNextColumn();
+                if (per_sec > 0.0f)
+                    ImGui::Text("%.0f", per_sec);
+                else
+                    ImGui::TextDisabled("0");
+            }
+
+            // Blank until the first sample, "-" if the process isn't ours to read
+            bool have_memory = show_memory && GetProcMemory(pid, procs.start_time[row], memory);
+            const long memory_kb[] = {memory.pss_kb, memory.uss_kb, memory.swap_kb};
+            for (long kb : memory_kb) {
+                ImGui::TableNextColumn();
+                if (!have_memory)
+                    continue;
+                if (memory.readable)
+                    ImGui::Text("%.1f", kb / 1024.0f);
+                else
+                    ImGui::TextDisabled("-");
+            }
+
+            ImGui::TableNextColumn();
+            static ProcHistoryView history;
+            if (GetProcHistory(pid, procs.start_time[row], history))
+                ShowSparkline("##cpu", history.cpu, history.count, 100.0f, cpu_color,
+                              ImVec2(-1, ImGui::GetTextLineHeight()));
 
             ImGui::TableNextColumn();
-            ImGui::TextUnformatted(proc.Command.c_str());
+            ImGui::TextUnformatted(procs.Command(row));
             ImGui::PopID();
         };
 
-        // Render pinned processes first
-        for (int i : pinned_indexes)
-            render_row(i);
+        // A thread line: TID, name and state, CPU; the rest is per process
+        auto render_thread = [&](int row, int thread) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            if (thread == -2) {
+                ImGui::TableNextColumn();
+                ImGui::TableNextColumn();
+                ImGui::TextDisabled("threads after the next scan");
+                return;
+            }
+            const ProcThread &t = flat_threads[procs.pid[row]]->threads[thread];
+            ImGui::TextDisabled("  %d", t.tid);
+            ImGui::TableNextColumn();
+            ImGui::TableNextColumn();
+            ImGui::TextDisabled("  %s [%c]", t.name, t.state);
+            ImGui::TableNextColumn();
+            ImVec4 cpu_color =
+                (t.cpu > 50.0f) ? ImVec4(1, 0.3f, 0.3f, 1)
+                : (t.cpu > 20.0f) ? ImVec4(1, 1, 0, 1)
+                                  : ImVec4(0.3f, 1, 0.3f, 1);
+            ImGui::TextColored(cpu_color, "%.1f", t.cpu);
+        };
+        auto render_item = [&](int index) {
+            if (items[index].thread == -1)
+                render_row(items[index].row, index);
+            else
+                render_thread(items[index].row, items[index].thread);
+        };
 
-        if (!pinned_indexes.empty())
-            ImGui::Separator();
+        // Selection requests name lines by index into items; a thread line
+        // stands for its process
+        struct FlatSelection {
+            const ProcSnapshot *procs;
+            const std::vector<FlatItem> *items;
+        } adapter = {&procs, &items};
+        proc_selection.UserData = &adapter;
+        proc_selection.AdapterIndexToStorageId = [](ImGuiSelectionBasicStorage *self, int index) {
+            const FlatSelection *flat = (const FlatSelection *)self->UserData;
+            return (ImGuiID)flat->procs->pid[(*flat->items)[index].row];
+        };
+        ImGuiMultiSelectIO *ms_io = ImGui::BeginMultiSelect(
+            ImGuiMultiSelectFlags_ClearOnEscape | ImGuiMultiSelectFlags_BoxSelect1d,
+            proc_selection.Size, (int)items.size());
+        proc_selection.ApplyRequests(ms_io);
+
+        for (int i = 0; i < frozen_count; i++)
+            render_item(i);
+
+        // Only the rows in view get widgets, plus the anchor of a shift-click
+        // range if it scrolled away
+        ImGuiListClipper clipper;
+        clipper.Begin((int)items.size() - frozen_count);
+        if (ms_io->RangeSrcItem >= frozen_count)
+            clipper.IncludeItemByIndex((int)ms_io->RangeSrcItem - frozen_count);
+        while (clipper.Step()) {
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+                render_item(frozen_count + i);
+        }
 
-        for (int i : normal_indexes)
-            render_row(i);
+        ms_io = ImGui::EndMultiSelect();
+        proc_selection.ApplyRequests(ms_io);
+        SyncSelectedPid(procs);
+        PublishHeld();
 
         ImGui::EndTable();
     }
@@ -137,262 +800,111 @@ void ShowProcessesV() {
     ImGui::EndChild();
 }
 
-void FetchProcesses() {
-    Procs.clear();
-    try {
-        if (fs::exists(dir_path) && fs::is_directory(dir_path)) {
-            for (const auto &entry : fs::directory_iterator(dir_path)) {
-                if (fs::is_directory(entry.status())) {
-                    std::string entry_pid = entry.path().filename().string();
-                    const char *entryp_path = entry.path().c_str();
-
-                    if (IsNumeric(entry_pid)) {
-                        int memory = GetMemoryUsage(entryp_path);
-
-                        Process proc;
-                        proc.Pid = entry_pid;
-                        proc.Name = GetProcName(entryp_path);
-                        proc.MemUsage = memory;
-                        proc.ParentId = GetProcPpid(entryp_path);
-                        proc.User = GetProcUser(entryp_path);
-                        proc.Command = GetProcCommand(entryp_path);
-                        proc.CpuUsage = GetProcCpuUsage(entry_pid);
-                        proc.ThreadCount = GetProcThreadCount(entryp_path);
-
-                        Procs.push_back(proc);
-                        // if(name)
-                        //     free(name);
-                    }
-                }
-            }
-
-            //  build parent-child relationships 
-            std::unordered_map<std::string, int> pidToIndex;
-            for (int i = 0; i < (int)Procs.size(); i++) {
-                pidToIndex[Procs[i].Pid] = i;
-                Procs[i].Children.clear(); // reset before rebuilding
-            }
-
-            for (int i = 0; i < (int)Procs.size(); i++) {
-                auto &proc = Procs[i];
-                if (pidToIndex.count(proc.ParentId)) {
-                    Procs[pidToIndex[proc.ParentId]].Children.push_back(i);
-                }
+// Per-row numeric key for one sort mode, smallest first. Names are ranked
+// once per distinct string, so no comparison ever touches the characters.
+static void FillSortKeys(const ProcSnapshot &s, SortMode mode, std::pmr::vector<double> &key) {
+    int rows = s.Size();
+    key.resize(rows);
+    switch (mode) {
+    case name_sort:
+    case name_desc: {
+        // The pool also holds users and commands; rank only the names
+        std::pmr::vector<uint32_t> rank(s.strings.offsets.size(), UINT32_MAX, key.get_allocator());
+        std::pmr::vector<uint32_t> ids(key.get_allocator());
+        for (int row = 0; row < rows; row++) {
+            if (rank[s.name_id[row]] == UINT32_MAX) {
+                rank[s.name_id[row]] = 0;
+                ids.push_back(s.name_id[row]);
             }
-
-            if (sortMode != no_sort)
-                SortProcesses(sortMode);
-        } else {
-            std::cerr << "[ERROR] Directory does not exist.\n";
         }
-    } catch (const fs::filesystem_error &error) {
-        std::cerr << "[ERROR] Filesystem Error: " << error.what() << "\n";
-    } catch (const std::exception &e) {
-        std::cerr << "[ERROR] " << e.what() << "\n";
+        std::sort(ids.begin(), ids.end(), [&s](uint32_t a, uint32_t b) {
+            return strcmp(s.strings.Get(a), s.strings.Get(b)) < 0;
+        });
+        for (size_t i = 0; i < ids.size(); i++)
+            rank[ids[i]] = (uint32_t)i;
+        for (int row = 0; row < rows; row++)
+            key[row] = rank[s.name_id[row]];
+        break;
     }
-}
-
-void SortProcesses(SortMode mode) {
-    switch (mode) {
-    case name_sort:
-        std::sort(Procs.begin(), Procs.end(),
-                  [](const Process &a, const Process &b) {
-                      return a.Name < b.Name;
-                  });
+    case pid_sort:
+    case pid_desc:
+        std::copy(s.pid.begin(), s.pid.end(), key.begin());
         break;
-
-    case name_desc:
-        std::sort(Procs.begin(), Procs.end(),
-                  [](const Process &a, const Process &b) {
-                      return a.Name > b.Name;
-                  });
+    case mem_sort:
+    case mem_desc:
+        std::copy(s.mem.begin(), s.mem.end(), key.begin());
         break;
-
-    case pid_sort: // ascending
-        std::sort(Procs.begin(), Procs.end(),
-                  [](const Process &a, const Process &b) {
-                      return std::stoi(a.Pid) < std::stoi(b.Pid);
-                  });
+    case cpu_sort:
+    case cpu_desc:
+        std::copy(s.cpu.begin(), s.cpu.end(), key.begin());
         break;
-
-    case pid_desc: // descending
-        std::sort(Procs.begin(), Procs.end(),
-                  [](const Process &a, const Process &b) {
-                      return std::stoi(a.Pid) > std::stoi(b.Pid);
-                  });
+    case thread_sort:
+    case thread_desc:
+        std::copy(s.threads.begin(), s.threads.end(), key.begin());
         break;
-
-    case mem_sort: // descending = high usage first
-        std::sort(Procs.begin(), Procs.end(),
-                  [](const Process &a, const Process &b) {
-                      return a.MemUsage > b.MemUsage;
-                  });
+    case subtree_cpu_sort:
+    case subtree_cpu_desc:
+        std::copy(s.subtree_cpu.begin(), s.subtree_cpu.end(), key.begin());
         break;
-
-    case mem_desc: // ascending
-        std::sort(Procs.begin(), Procs.end(),
-                  [](const Process &a, const Process &b) {
-                      return a.MemUsage < b.MemUsage;
-                  });
+    case subtree_mem_sort:
+    case subtree_mem_desc:
+        std::copy(s.subtree_mem.begin(), s.subtree_mem.end(), key.begin());
         break;
-
-    case cpu_sort: // descending high CPU first
-        std::sort(Procs.begin(), Procs.end(),
-                  [](const Process &a, const Process &b) {
-                      return a.CpuUsage > b.CpuUsage;
-                  });
+    case io_read_sort:
+    case io_read_desc:
+        std::copy(s.io_read.begin(), s.io_read.end(), key.begin());
         break;
-
-    case cpu_desc: // ascending
-        std::sort(Procs.begin(), Procs.end(),
-                  [](const Process &a, const Process &b) {
-                      return a.CpuUsage < b.CpuUsage;
-                  });
+    case io_write_sort:
+    case io_write_desc:
+        std::copy(s.io_write.begin(), s.io_write.end(), key.begin());
         break;
-
-    case thread_sort: // descending
-        std::sort(Procs.begin(), Procs.end(),
-                  [](const Process &a, const Process &b) {
-                      return a.ThreadCount > b.ThreadCount;
-                  });
+    case minflt_sort:
+    case minflt_desc:
+        std::copy(s.minflt.begin(), s.minflt.end(), key.begin());
         break;
-
-    case thread_desc: // ascending
-        std::sort(Procs.begin(), Procs.end(),
-                  [](const Process &a, const Process &b) {
-                      return a.ThreadCount < b.ThreadCount;
-                  });
+    case majflt_sort:
+    case majflt_desc:
+        std::copy(s.majflt.begin(), s.majflt.end(), key.begin());
+        break;
+    case vcsw_sort:
+    case vcsw_desc:
+        std::copy(s.vcsw.begin(), s.vcsw.end(), key.begin());
+        break;
+    case nvcsw_sort:
+    case nvcsw_desc:
+        std::copy(s.nvcsw.begin(), s.nvcsw.end(), key.begin());
         break;
-
     default:
+        std::fill(key.begin(), key.end(), 0.0);
         break;
     }
-}
-
-bool IsNumeric(std::string dir_name) {
-    char *buffer;
-    std::strtol(dir_name.c_str(), &buffer, 10);
-    return *buffer == 0;
-}
-
-std::string GetProcName(const char *path) {
-    char status_file[64];
-    snprintf(status_file, sizeof(status_file), "%s/status", path);
-    FILE *pf = fopen(status_file, "r");
-    if (!pf)
-        return "{Unknown}";
-    char line[128];
-    std::string name = "{Unknown}";
-    while (fgets(line, sizeof(line), pf)) {
-        if (strncmp(line, "Name:", 5) == 0) {
-            name = std::string(line + 6);
-            // trim leading spaces
-            name.erase(0, name.find_first_not_of(" \t"));
-            // trim trailing newline
-            name.erase(name.find_last_not_of("\n") + 1);
-            break;
-        }
-    }
-    fclose(pf);
-    return name;
-}
-
-std::string GetProcCommand(const char *path) {
-    char cmd_file[64];
-    snprintf(cmd_file, sizeof(cmd_file), "%s/cmdline", path);
-    FILE *pf = fopen(cmd_file, "r");
-    if (!pf)
-        return "{Unknown}";
-    std::string cmd;
-    char ch;
-    while ((ch = fgetc(pf)) != EOF) {
-        cmd += (ch == '\0') ? ' ' : ch;
-    }
-    fclose(pf);
-    return cmd.empty() ? "{Unknown}" : cmd;
-}
 
-std::string GetProcUser(const char *path) {
-    struct stat info;
-    if (stat(path, &info) != 0)
-        return "[WARN] Unknown";
-    struct passwd *pw = getpwuid(info.st_uid);
-    return pw ? pw->pw_name : "Unknown";
+    // name and pid "sort" are ascending; the usage ones put the biggest first
+    bool descending = mode == name_desc || mode == pid_desc || mode == mem_sort ||
+                      mode == cpu_sort || mode == thread_sort ||
+                      mode == subtree_cpu_sort || mode == subtree_mem_sort ||
+                      mode == io_read_sort || mode == io_write_sort ||
+                      mode == minflt_sort || mode == majflt_sort ||
+                      mode == vcsw_sort || mode == nvcsw_sort;
+    if (descending)
+        for (double &k : key)
+            k = -k;
 }
 
-int GetProcThreadCount(const char *path) {
-    char status_file[64];
-    snprintf(status_file, sizeof(status_file), "%s/status", path);
-    FILE *pf = fopen(status_file, "r");
-    if (!pf)
-        return -1;
-    char line[128];
-    int threads = -1;
-    while (fgets(line, sizeof(line), pf)) {
-        if (strncmp(line, "Threads:", 8) == 0) {
-            sscanf(line + 8, "%d", &threads);
-            break;
-        }
+// Sorts row indices by one or more modes, most significant first; the
+// columns themselves never move. One stable pass per key, least significant
+// first, so each pass keeps the order of the ones before it on ties.
+void SortProcesses(const ProcSnapshot &snapshot, const SortMode *keys, int key_count,
+                   std::pmr::vector<int32_t> &order) {
+    std::pmr::vector<double> key(order.get_allocator());
+    for (int k = key_count - 1; k >= 0; k--) {
+        if (keys[k] == no_sort)
+            continue;
+        FillSortKeys(snapshot, keys[k], key);
+        std::stable_sort(order.begin(), order.end(), [&key](int32_t a, int32_t b) {
+            return key[a] < key[b];
+        });
     }
-    fclose(pf);
-    return threads;
-}
-
-float GetProcCpuUsage(const std::string &pid) {
-    char stat_file[64];
-    snprintf(stat_file, sizeof(stat_file), "/proc/%s/stat", pid.c_str());
-    FILE *pf = fopen(stat_file, "r");
-    if (!pf)
-        return 0.0f;
-    long utime, stime;
-    long clk_tck = sysconf(_SC_CLK_TCK);
-
-    // Extract needed fields from /proc/[pid]/stat file
-    // Format: pid (comm) state ppid ... utime stime ... starttime ...
-    char comm[256], state;
-    int ppid, pgrp, session, tty_nr, tpgid;
-    unsigned flags;
-    unsigned long cutime, cstime, priority, nice, num_threads, itrealvalue;
-    unsigned long long start_time_ticks;
-    unsigned long vsize;
-    long rss_val;
-    int f = fscanf(pf,
-                   "%*d %*s %*c "
-                   "%*d %*d %*d %*d %*d "
-                   "%*u %*u %*u %*u %lu %lu "
-                   "%*d %*d %*d %*d %*d %*d "
-                   "%llu",
-                   &utime, &stime, &start_time_ticks);
-    fclose(pf);
-    long total_time = utime + stime;
-
-    // System uptime
-    float uptime_secs = 0;
-    pf = fopen("/proc/uptime", "r");
-    if (!pf)
-        return 0.0f;
-    fscanf(pf, "%f", &uptime_secs);
-    fclose(pf);
-
-    // Seconds the process has been running
-    float seconds = uptime_secs - (start_time_ticks / (float)clk_tck);
-    if (seconds <= 0)
-        return 0.0f;
-    float cpu_usage = 100.0f * ((total_time / (float)clk_tck) / seconds);
-    return cpu_usage;
-}
-
-std::string GetProcPpid(const char* path) {
-    char stat_file[64];
-    snprintf(stat_file, sizeof(stat_file), "%s/stat", path);
-    FILE* pf = fopen(stat_file, "r");
-    if (!pf) return "0";
-    
-    int pid, ppid;
-    char comm[256], state;
-    fscanf(pf, "%d %s %c %d", &pid, comm, &state, &ppid);
-    fclose(pf);
-    return std::to_string(ppid);
 }
 
 void ReadMemInfo() {
@@ -419,157 +931,340 @@ void ReadMemInfo() {
     fclose(pf);
 }
 
-int GetMemoryUsage(const char *path) {
-    char status_file[64];
-    snprintf(status_file, sizeof(status_file), "%s/status", path);
-
-    FILE *pf = fopen(status_file, "r");
-    if (pf == nullptr) {
-        fprintf(stderr, "[ERROR] Failed opening file\n");
-        return -1;
-    }
-
-    char line[64];
-    int memory = -1;
-
-    while (fgets(line, sizeof(line), pf)) {
-        if (strncmp(line, "VmRSS:", 6) == 0) {
-            sscanf(line + 6, "%d", &memory); // Skip "VmRSS:"
-            // printf("[INFO] %s", line);
-            break;
-        }
+// Goes through a pidfd, so a PID recycled since the snapshot is never hit
+void KillProc(int pid, unsigned long long start_time) {
+    if (pid <= 0)
+        return;
+    if (!SignalProcess(pid, start_time, SIGKILL)) {
+        std::cout << "[ERROR] Failed Killing Task\n";
     }
-    fclose(pf);
-    return memory;
 }
 
-void KillProc(std::string proc_pid) {
-    pid_t pid;
-    try {
-        pid_t pid = std::stoi(proc_pid);
-        if (kill(pid, SIGKILL) != 0) {
-            std::cout << "[ERROR] Failed Killing Task\n";
-        }
-    } catch (const std::invalid_argument &e) {
-        std::cerr << "Invalid number\n";
-    } catch (const std::out_of_range &e) {
-        std::cerr << "Number out of range\n";
-    }
+// Lays the tree out again like the sampler does, with
+// siblings and roots in header order. Without header keys the snapshot's
+// own layout is used.
+static void SortTree(const ProcSnapshot &procs) {
+    sorted_tree_rows.assign(procs.tree_rows.begin(), procs.tree_rows.end());
+    sorted_tree_depth.assign(procs.tree_depth.begin(), procs.tree_depth.end());
+    sorted_tree_end.assign(procs.tree_end.begin(), procs.tree_end.end());
+    if (tree_sort_keys.empty())
+        return;
+
+    // Re-sorting the sampler's order, so ties keep it
+    int rows = procs.Size();
+    std::pmr::vector<int32_t> order(procs.order.begin(), procs.order.end());
+    SortProcesses(procs, tree_sort_keys.data(), (int)tree_sort_keys.size(), order);
+    std::vector<int32_t> rank(rows);
+    for (int i = 0; i < (int)order.size(); i++)
+        rank[order[i]] = i;
+    std::pmr::vector<int32_t> children(procs.child_rows.begin(), procs.child_rows.end());
+    for (int row = 0; row < rows; row++)
+        std::sort(children.begin() + procs.child_begin[row],
+                  children.begin() + procs.child_begin[row + 1],
+                  [&rank](int32_t a, int32_t b) { return rank[a] < rank[b]; });
+    std::vector<bool> root(rows, false);
+    for (int pos = 0; pos < (int)procs.tree_rows.size(); pos++)
+        if (procs.tree_depth[pos] == 0)
+            root[procs.tree_rows[pos]] = true;
+    std::pmr::vector<int32_t> roots;
+    for (int32_t row : order)
+        if (root[row])
+            roots.push_back(row);
+
+    LayOutTree(procs.child_begin, children, roots, sorted_tree_rows, sorted_tree_depth,
+               sorted_tree_end);
 }
 
 void ShowProcessesTree() {
     ImGui::BeginChild("ProcTree", ImVec2(0, 400), true);
 
+    std::shared_ptr<const ProcSnapshot> snapshot = GetProcSnapshot();
+    if (!snapshot) {
+        ImGui::TextDisabled("Loading processes...");
+        ImGui::EndChild();
+        return;
+    }
+    const ProcSnapshot &procs = *snapshot;
+    ShowBatchStatus();
+
+    // Tree positions that are on screen: everything whose ancestors are all
+    // expanded. Rebuilt only for a new snapshot or after a toggle.
+    if (tree_visible_generation != procs.generation)
+        CleanupPinned(procs);
+    if (tree_visible_generation != procs.generation || tree_sort_dirty) {
+        SortTree(procs);
+        tree_sort_dirty = false;
+        tree_visible_dirty = true;
+    }
+    if (tree_visible_generation != procs.generation || tree_visible_dirty) {
+        tree_visible.clear();
+        int count = (int)sorted_tree_rows.size();
+        for (int pos = 0; pos < count;) {
+            tree_visible.push_back(pos);
+            int row = sorted_tree_rows[pos];
+            bool expanded = HasProcKey(expanded_pids, procs.pid[row], procs.start_time[row]);
+            pos = expanded ? pos + 1 : sorted_tree_end[pos]; // skip a collapsed subtree
+        }
+        tree_visible_generation = procs.generation;
+        tree_visible_dirty = false;
+    }
+
     static ImGuiTableFlags flags =
         ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_RowBg |
         ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_Resizable |
         ImGuiTableFlags_ScrollY;
 
-    if (ImGui::BeginTable("ProcTreeTable", 7, flags)) {
+    if (ImGui::BeginTable("ProcTreeTable", 10, flags | ImGuiTableFlags_Sortable |
+                                                 ImGuiTableFlags_SortTristate)) {
+        ImGuiTableColumnFlags fixed = ImGuiTableColumnFlags_WidthFixed;
+        ImGuiTableColumnFlags no_sort_col = ImGuiTableColumnFlags_NoSort;
         ImGui::TableSetupScrollFreeze(0, 1);
-        ImGui::TableSetupColumn("PID", ImGuiTableColumnFlags_WidthFixed, 60.0f);
-        ImGui::TableSetupColumn("User", ImGuiTableColumnFlags_WidthFixed, 80.0f);
-        ImGui::TableSetupColumn("Name");
-        ImGui::TableSetupColumn("%CPU", ImGuiTableColumnFlags_WidthFixed, 60.0f);
-        ImGui::TableSetupColumn("Mem (MB)", ImGuiTableColumnFlags_WidthFixed, 80.0f);
-        ImGui::TableSetupColumn("Threads", ImGuiTableColumnFlags_WidthFixed, 60.0f);
-        ImGui::TableSetupColumn("Command");
+        ImGui::TableSetupColumn("PID", fixed, 60.0f, sort_pid);
+        ImGui::TableSetupColumn("User", fixed | no_sort_col, 80.0f);
+        ImGui::TableSetupColumn("Name", 0, 0.0f, sort_name);
+        ImGui::TableSetupColumn("%CPU", fixed, 60.0f, sort_cpu);
+        ImGui::TableSetupColumn("Mem (MB)", fixed, 80.0f, sort_mem);
+        ImGui::TableSetupColumn("Threads", fixed, 60.0f, sort_threads);
+        ImGui::TableSetupColumn("Sub %CPU", fixed, 70.0f, sort_subtree_cpu);
+        ImGui::TableSetupColumn("Sub Mem (MB)", fixed, 90.0f, sort_subtree_mem);
+        ImGui::TableSetupColumn("Sub Threads", fixed | no_sort_col, 80.0f);
+        ImGui::TableSetupColumn("Command", no_sort_col);
         ImGui::TableHeadersRow();
 
-        // Show only root processes (PPID=0 or not found)
-        for (int i = 0; i < (int)Procs.size(); i++) {
-            if (Procs[i].ParentId == "0") {
-                ShowProcessNode(i); // recursive renderer
+        // Siblings are re-sorted here from the next frame; the sampler's
+        // sort mode, and with it the flat view, is left alone
+        ImGuiTableSortSpecs *sort_specs = ImGui::TableGetSortSpecs();
+        if (sort_specs && sort_specs->SpecsDirty) {
+            tree_sort_keys.clear();
+            if (sort_specs->SpecsCount > 0)
+                tree_sort_keys.push_back(HeaderSortMode(sort_specs->Specs[0]));
+            tree_sort_dirty = true;
+            sort_specs->SpecsDirty = false;
+        }
+
+        // Selection requests name nodes by index into tree_visible
+        proc_selection.UserData = (void *)&procs;
+        proc_selection.AdapterIndexToStorageId = [](ImGuiSelectionBasicStorage *self, int index) {
+            const ProcSnapshot *tree = (const ProcSnapshot *)self->UserData;
+            return (ImGuiID)tree->pid[sorted_tree_rows[tree_visible[index]]];
+        };
+        ImGuiMultiSelectIO *ms_io = ImGui::BeginMultiSelect(
+            ImGuiMultiSelectFlags_ClearOnEscape | ImGuiMultiSelectFlags_BoxSelect1d,
+            proc_selection.Size, (int)tree_visible.size());
+        proc_selection.ApplyRequests(ms_io);
+
+        ImGuiListClipper clipper;
+        clipper.Begin((int)tree_visible.size());
+        if (ms_io->RangeSrcItem != -1)
+            clipper.IncludeItemByIndex((int)ms_io->RangeSrcItem);
+        while (clipper.Step()) {
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+                int pos = tree_visible[i];
+                int row = sorted_tree_rows[pos];
+                int pid = procs.pid[row];
+                bool expanded = HasProcKey(expanded_pids, pid, procs.start_time[row]);
+                if (ShowProcessNode(procs, pos, i, expanded) != expanded) {
+                    if (expanded)
+                        expanded_pids.erase(pid);
+                    else
+                        expanded_pids[pid] = procs.start_time[row];
+                    tree_visible_dirty = true;
+                }
             }
         }
 
+        ms_io = ImGui::EndMultiSelect();
+        proc_selection.ApplyRequests(ms_io);
+        SyncSelectedPid(procs);
+        PublishHeld();
+
         ImGui::EndTable();
     }
 
     ImGui::EndChild();
 }
 
-void ShowProcessNode(int idx) {
-    Process &proc = Procs[idx];
-
+// One row of the flattened tree. Returns whether the node should be
+// expanded from now on.
+bool ShowProcessNode(const ProcSnapshot &procs, int pos, int index, bool expanded) {
+    int row = sorted_tree_rows[pos];
+    int depth = sorted_tree_depth[pos];
+    int pid = procs.pid[row];
+    float cpu = procs.cpu[row];
+
+    // The table indents the first column by the indent at the start of the row
+    float indent = depth * ImGui::GetStyle().IndentSpacing;
+    if (indent > 0.0f)
+        ImGui::Indent(indent);
     ImGui::TableNextRow();
-    ImGui::PushID(idx);
+    ImGui::PushID(pid);
 
     // Color logic
     ImVec4 cpu_color =
-        (proc.CpuUsage > 50.0f)   ? ImVec4(1.0f, 0.3f, 0.3f, 1.0f)  // red
-        : (proc.CpuUsage > 20.0f) ? ImVec4(1.0f, 1.0f, 0.0f, 1.0f)  // yellow
-        : ImVec4(0.3f, 1.0f, 0.3f, 1.0f);                           // green
+        (cpu > 50.0f)   ? ImVec4(1.0f, 0.3f, 0.3f, 1.0f)  // red
+        : (cpu > 20.0f) ? ImVec4(1.0f, 1.0f, 0.0f, 1.0f)  // yellow
+        : ImVec4(0.3f, 1.0f, 0.3f, 1.0f);                 // green
 
-    float memMB = proc.MemUsage / 1024.0f;
+    float memMB = procs.mem[row] / 1024.0f;
     ImVec4 mem_color =
         (memMB > 200.0f)   ? ImVec4(1.0f, 0.3f, 0.3f, 1.0f)  // red
         : (memMB > 100.0f) ? ImVec4(1.0f, 1.0f, 0.0f, 1.0f)  // yellow
         : ImVec4(0.3f, 1.0f, 0.3f, 1.0f);                   // green
 
     // subtle color by depth in tree (for hierarchy clarity)
-    int depth = 0;
-    for (int parent = std::stoi(proc.ParentId);
-         parent != 0 && parent < (int)Procs.size(); ) {
-        parent = std::stoi(Procs[parent].ParentId);
-        depth++;
-    }
     float intensity = std::max(0.2f, 1.0f - depth * 0.1f);
     ImVec4 row_tint = ImVec4(intensity, intensity, 1.0f, 1.0f);
 
     ImGui::TableNextColumn();
+    bool has_children = sorted_tree_end[pos] > pos + 1;
     ImGuiTreeNodeFlags nodeFlags =
-        ImGuiTreeNodeFlags_SpanFullWidth |
-        (proc.Children.empty() ? ImGuiTreeNodeFlags_Leaf : 0) |
-        ((proc.Pid == selected_pid) ? ImGuiTreeNodeFlags_Selected : 0);
+        ImGuiTreeNodeFlags_SpanFullWidth | ImGuiTreeNodeFlags_NoTreePushOnOpen |
+        (has_children ? 0 : ImGuiTreeNodeFlags_Leaf) |
+        (proc_selection.Contains(pid) ? ImGuiTreeNodeFlags_Selected : 0);
 
     // Use tinted color for text (PID)
     ImGui::PushStyleColor(ImGuiCol_Text, row_tint);
-    bool open = ImGui::TreeNodeEx(proc.Pid.c_str(), nodeFlags, "%s", proc.Pid.c_str());
+    ImGui::SetNextItemOpen(expanded);
+    ImGui::SetNextItemSelectionUserData(index);
+    bool open = ImGui::TreeNodeEx("##node", nodeFlags, "%d", pid);
     ImGui::PopStyleColor();
 
-    if (ImGui::IsItemClicked()) {
-        selected_pid = (proc.Pid == selected_pid ? "" : proc.Pid);
+    if (ImGui::IsItemClicked() && !ImGui::IsItemToggledOpen()) {
+        clicked_pid = pid;
+    }
+
+    if (ImGui::BeginPopupContextItem()) {
+        if (ImGui::MenuItem("Expand Subtree", nullptr, false, has_children)) {
+            for (int i = pos; i < sorted_tree_end[pos]; i++)
+                expanded_pids[procs.pid[sorted_tree_rows[i]]] = procs.start_time[sorted_tree_rows[i]];
+            tree_visible_dirty = true;
+            open = true;
+        }
+        if (ImGui::MenuItem("Collapse Subtree", nullptr, false, has_children)) {
+            for (int i = pos; i < sorted_tree_end[pos]; i++)
+                EraseProcKey(expanded_pids, {procs.pid[sorted_tree_rows[i]], procs.start_time[sorted_tree_rows[i]]});
+            tree_visible_dirty = true;
+            open = false;
+        }
+        if (MenuOnSelection(pid))
+            ShowSelectionMenu(procs);
+        ShowProcControlMenu(procs, row);
+        ImGui::EndPopup();
     }
 
     // Other columns 
     ImGui::TableNextColumn();
-    ImGui::TextUnformatted(proc.User.c_str());
+    ImGui::TextUnformatted(procs.User(row));
 
     ImGui::TableNextColumn();
-    ImGui::TextUnformatted(proc.Name.c_str());
+    ImGui::TextUnformatted(procs.Name(row));
 
     ImGui::TableNextColumn();
-    ImGui::TextColored(cpu_color, "%.1f", proc.CpuUsage);
+    ImGui::TextColored(cpu_color, "%.1f", cpu);
 
     ImGui::TableNextColumn();
     ImGui::TextColored(mem_color, "%.1f", memMB);
 
     ImGui::TableNextColumn();
-    ImGui::Text("%d", proc.ThreadCount);
+    ImGui::Text("%d", procs.threads[row]);
 
+    // Totals only mean something for rows with children
     ImGui::TableNextColumn();
-    ImGui::TextUnformatted(proc.Command.c_str());
+    if (has_children)
+        ImGui::Text("%.1f", procs.subtree_cpu[row]);
 
-    // Recursive children rendering
-    if (open) {
-        for (int childIdx : proc.Children) {
-            ShowProcessNode(childIdx);
-        }
-        ImGui::TreePop();
-    }
+    ImGui::TableNextColumn();
+    if (has_children)
+        ImGui::Text("%.1f", procs.subtree_mem[row] / 1024.0f);
+
+    ImGui::TableNextColumn();
+    if (has_children)
+        ImGui::Text("%d", procs.subtree_threads[row]);
+
+    ImGui::TableNextColumn();
+    ImGui::TextUnformatted(procs.Command(row));
 
     ImGui::PopID();
+    if (indent > 0.0f)
+        ImGui::Unindent(indent);
+    return has_children && open;
+}
+
+// Selected process: its history over the last PROC_HISTORY_SIZE scans, and
+// the details the background loader fetches for it
+void ShowProcessDetails() {
+    std::shared_ptr<const ProcSnapshot> snapshot = GetProcSnapshot();
+    if (!snapshot)
+        return;
+    static unsigned long long pruned_generation = 0;
+    if (pruned_generation != snapshot->generation) {
+        PruneProcDetails(*snapshot);
+        pruned_generation = snapshot->generation;
+    }
+
+    if (selected_pid == 0)
+        return;
+    auto it = std::find(snapshot->pid.begin(), snapshot->pid.end(), selected_pid);
+    if (it == snapshot->pid.end())
+        return;
+    int row = (int)(it - snapshot->pid.begin());
+
+    ImGui::BeginChild("ProcDetails", ImVec2(0, 260), true);
+    ImGui::Text("%d  %s", selected_pid, snapshot->Name(row));
+    ImGui::SameLine();
+    ImGui::TextDisabled("(%.1f KB of history in use)", ProcHistoryBytes() / 1024.0f);
+
+    if (ImGui::BeginTabBar("##DetailTabs")) {
+        if (ImGui::BeginTabItem("History")) {
+            static ProcHistoryView history;
+            GetProcHistory(selected_pid, snapshot->start_time[row], history);
+            ShowProcHistoryPlot(history, -1);
+            ImGui::EndTabItem();
+        }
+
+        std::shared_ptr<const ProcDetails> details =
+            GetProcDetails(selected_pid, snapshot->start_time[row]);
+        if (details) {
+            ShowProcDetails(*details);
+        } else if (ImGui::BeginTabItem("Loading...")) {
+            ImGui::TextDisabled("Reading /proc/%d in the background", selected_pid);
+            ImGui::EndTabItem();
+        }
+        ImGui::EndTabBar();
+    }
+    ImGui::EndChild();
 }
 
-void CleanupPinned() {
-    std::unordered_set<std::string> valid;
-    for (const auto &p : Procs)
-        valid.insert(p.Pid);
+// Once per snapshot: drops pins, expansions and selections of processes
+// that are gone. Held ones are dropped as they exit already; this catches
+// the rest, e.g. without pidfd support. Exited rows stop showing once a
+// scan missed them.
+void CleanupPinned(const ProcSnapshot &snapshot) {
+    // A top-N snapshot scanned before the sampler got the current held set
+    // can leave out held processes that are alive
+    if (snapshot.stats.top_n && snapshot.held_version < held_version)
+        return;
 
-    for (auto it = pinned_pids.begin(); it != pinned_pids.end();)
-        if (!valid.count(*it))
-            it = pinned_pids.erase(it);
-        else
-            ++it;
+    std::unordered_map<int, unsigned long long> valid;
+    valid.reserve(snapshot.pid.size());
+    for (int row = 0; row < snapshot.Size(); row++)
+        valid[snapshot.pid[row]] = snapshot.start_time[row];
+
+    DropGone(pinned_pids, valid);
+    DropGone(thread_pids, valid);
+    // Tree expansions aren't held, so only a full scan says they're gone
+    if (!snapshot.stats.top_n)
+        DropGone(expanded_pids, valid);
+    DropGone(exited_pids, valid);
+    DropGone(selected_keys, valid);
+    static std::vector<ImGuiID> stale;
+    stale.clear();
+    void *selected = nullptr;
+    ImGuiID id;
+    while (proc_selection.GetNextSelectedItem(&selected, &id))
+        if (!selected_keys.count((int)id))
+            stale.push_back(id);
+    for (ImGuiID gone : stale)
+        proc_selection.SetItemSelected(gone, false);
+    flat_rows_dirty = true;
 }
@@ -0,0 +1,213 @@
+#include "../punktop.h"
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+
+// Process lifecycle events from the kernel proc connector. The listener thread
+// captures new and exec'd processes while they still exist, and the sampler
+// drains them into its table at the start of each scan.
+std::atomic<unsigned long long> procEventOnly{0};
+
+static std::atomic<bool> events_running{false};
+// The kernel ignores the subscription outside the init namespaces without
+// saying so; only its ack, or a first event, shows events will arrive
+static std::atomic<bool> events_confirmed{false};
+static std::mutex event_mtx;
+struct Capture {
+    ProcEntry entry;
+    bool forked = false; // first seen through its fork, not an exec
+};
+static std::unordered_map<int, Capture> pending; // pid -> capture since the last drain
+static bool overflowed = false;
+
+// Fixed inode numbers of the initial namespaces (PROC_PID_INIT_INO, PROC_USER_INIT_INO)
+static bool InInitNamespaces() {
+    struct stat pid_ns, user_ns;
+    if (stat("/proc/self/ns/pid", &pid_ns) != 0 || stat("/proc/self/ns/user", &user_ns) != 0)
+        return false;
+    return pid_ns.st_ino == 0xEFFFFFFCU && user_ns.st_ino == 0xEFFFFFFDU;
+}
+
+static int OpenProcConnector() {
+    if (!InInitNamespaces())
+        return -1;
+
+    int sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (sock < 0)
+        return -1;
+
+    struct sockaddr_nl addr = {};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC;
+    addr.nl_pid = 0; // let the kernel pick
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(sock);
+        return -1;
+    }
+
+    // Ask for the proc event multicast
+    char buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))] = {};
+    struct nlmsghdr *hdr = (struct nlmsghdr *)buf;
+    hdr->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op));
+    hdr->nlmsg_type = NLMSG_DONE;
+    hdr->nlmsg_pid = getpid();
+    struct cn_msg *msg = (struct cn_msg *)NLMSG_DATA(hdr);
+    msg->id.idx = CN_IDX_PROC;
+    msg->id.val = CN_VAL_PROC;
+    msg->seq = getpid(); // echoed in the ack, which every listener receives
+    msg->ack = 0;
+    msg->len = sizeof(enum proc_cn_mcast_op);
+    *(enum proc_cn_mcast_op *)msg->data = PROC_CN_MCAST_LISTEN;
+    if (send(sock, buf, hdr->nlmsg_len, 0) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    // Bursts of forks must not overflow the socket; wake up to check is_finished
+    int rcvbuf = 1 << 20;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct timeval timeout = {0, 500 * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return sock;
+}
+
+// Reads what the sampler needs while the process is still there
+static void CaptureProcess(ProcReader &reader, int pid, bool forked) {
+    ProcEntry entry;
+    if (!reader.Read(pid, entry.sample)) {
+        // Gone already is fine; anything else (EMFILE...) would hide it for good
+        if (errno != ENOENT && errno != ESRCH) {
+            std::lock_guard<std::mutex> lock(event_mtx);
+            overflowed = true;
+        }
+        return;
+    }
+    entry.pid = pid;
+    entry.name = entry.sample.name;
+    entry.command = reader.ReadCommand(pid);
+
+    std::lock_guard<std::mutex> lock(event_mtx);
+    Capture &capture = pending[pid];
+    capture.entry = std::move(entry);
+    capture.forked |= forked;
+}
+
+static void HandleEvent(ProcReader &reader, const struct proc_event *event) {
+    switch (event->what) {
+    case proc_event::PROC_EVENT_FORK:
+        // Threads show up as forks too; only new thread group leaders are processes
+        if (event->event_data.fork.child_pid == event->event_data.fork.child_tgid)
+            CaptureProcess(reader, event->event_data.fork.child_pid, true);
+        break;
+
+    case proc_event::PROC_EVENT_EXEC:
+        // Name and cmdline change on exec
+        CaptureProcess(reader, event->event_data.exec.process_tgid, false);
+        break;
+
+    case proc_event::PROC_EVENT_EXIT:
+        if (event->event_data.exit.process_pid == event->event_data.exit.process_tgid) {
+            std::lock_guard<std::mutex> lock(event_mtx);
+            auto it = pending.find(event->event_data.exit.process_pid);
+            if (it != pending.end()) {
+                // Born and gone between two scans: only the events ever saw it
+                if (it->second.forked)
+                    procEventOnly++;
+                pending.erase(it);
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void WatchProcEvents(int sock) {
+    ProcDir proc_dir; // only for the fd the reader opens files against
+    ProcReader reader;
+    reader.proc_fd = proc_dir.Fd();
+
+    // Without a confirmation in time the sampler keeps polling
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    alignas(struct nlmsghdr) char buf[16384];
+    while (!is_finished) {
+        if (!events_confirmed && std::chrono::steady_clock::now() > deadline) {
+            std::cout << "[INFO] Proc connector never confirmed, polling /proc\n";
+            break;
+        }
+        ssize_t len = recv(sock, buf, sizeof(buf), 0);
+        if (len < 0) {
+            if (errno == ENOBUFS) {
+                // Events were dropped; the next scan has to list /proc again
+                std::lock_guard<std::mutex> lock(event_mtx);
+                overflowed = true;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "[ERROR] Proc connector failed, back to polling\n";
+                break;
+            }
+            continue;
+        }
+
+        bool refused = false;
+        for (struct nlmsghdr *hdr = (struct nlmsghdr *)buf; NLMSG_OK(hdr, (size_t)len);
+             hdr = NLMSG_NEXT(hdr, len)) {
+            if (hdr->nlmsg_type == NLMSG_ERROR || hdr->nlmsg_type == NLMSG_NOOP)
+                continue;
+            struct cn_msg *msg = (struct cn_msg *)NLMSG_DATA(hdr);
+            if (msg->id.idx != CN_IDX_PROC || msg->id.val != CN_VAL_PROC)
+                continue;
+            const struct proc_event *event = (const struct proc_event *)msg->data;
+            if (event->what == proc_event::PROC_EVENT_NONE) {
+                // An ack; ours carries our seq, the others belong to other listeners
+                if (!events_confirmed && msg->seq == (__u32)getpid() && msg->ack == 1) {
+                    if (event->event_data.ack.err != 0)
+                        refused = true;
+                    else
+                        events_confirmed = true;
+                }
+                continue;
+            }
+            events_confirmed = true;
+            HandleEvent(reader, event);
+        }
+        if (refused) {
+            std::cout << "[INFO] Proc connector refused the subscription, polling /proc\n";
+            break;
+        }
+    }
+
+    events_running = false;
+    events_confirmed = false;
+    close(sock);
+}
+
+bool StartProcEvents() {
+    int sock = OpenProcConnector();
+    if (sock < 0) {
+        std::cout << "[INFO] Proc connector unavailable, polling /proc\n";
+        return false;
+    }
+    events_running = true;
+    std::thread watcher(WatchProcEvents, sock);
+    watcher.detach();
+    return true;
+}
+
+bool DrainProcEvents(std::vector<ProcEntry> &captured, bool &missed_events) {
+    captured.clear();
+    if (!events_running || !events_confirmed)
+        return false;
+
+    std::lock_guard<std::mutex> lock(event_mtx);
+    for (auto &[pid, capture] : pending)
+        captured.push_back(std::move(capture.entry));
+    pending.clear();
+    missed_events = overflowed;
+    overflowed = false;
+    return true;
+}
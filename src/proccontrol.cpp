@@ -0,0 +1,278 @@
+#include "../punktop.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+// Batches of signals, scheduling changes and exports, run on a worker
+// thread so that hundreds of processes never stall a frame. Affinity, nice
+// and I/O priority are all per thread on Linux, so those changes walk
+// /proc/[pid]/task and are made thread by thread.
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+
+static int IoprioGet(int tid) {
+    return (int)syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, tid);
+}
+
+static int IoprioSet(int tid, int ioprio) {
+    return (int)syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, ioprio);
+}
+
+// Outcome of one batch, counted per process
+struct BatchResult {
+    int processes = 0; // in the batch
+    int applied = 0;   // every thread changed, signalled or written
+    int threads = 0;
+    int denied = 0;    // EPERM/EACCES, e.g. lowering nice without CAP_SYS_NICE
+    int gone = 0;      // exited, or the PID was recycled
+    int failed = 0;
+};
+
+// Runs change on every thread of the process. The start time is checked
+// first, so a PID recycled since the snapshot is left alone; a recycle in
+// the microseconds after the check can't be ruled out, as there is no
+// pidfd form of these calls.
+static void ApplyToThreads(ProcReader &reader, const ProcKey &key,
+                           const std::function<int(int tid)> &change, BatchResult &result) {
+    static std::vector<int> tids; // worker thread only
+    ProcSample sample;
+    if (!reader.Read(key.pid, sample) || sample.start_time != key.start_time ||
+        !reader.ListTasks(key.pid, tids)) {
+        result.gone++;
+        return;
+    }
+
+    int error = 0;
+    for (int tid : tids) {
+        if (change(tid) == 0)
+            result.threads++;
+        else if (errno != ESRCH) // a thread exiting meanwhile is fine
+            error = errno;
+    }
+    if (error == 0)
+        result.applied++;
+    else if (error == EPERM || error == EACCES)
+        result.denied++;
+    else
+        result.failed++;
+}
+
+// Current settings of the process's main thread, to start the editors from
+bool GetProcControls(int pid, ProcControls &out) {
+    CPU_ZERO(&out.cpus);
+    if (sched_getaffinity(pid, sizeof(out.cpus), &out.cpus) != 0)
+        return false;
+
+    errno = 0;
+    int nice = getpriority(PRIO_PROCESS, pid);
+    if (nice == -1 && errno != 0)
+        return false;
+    out.nice = nice;
+
+    int ioprio = IoprioGet(pid);
+    if (ioprio < 0)
+        return false;
+    out.io_class = ioprio >> IOPRIO_CLASS_SHIFT;
+    out.io_level = ioprio & ((1 << IOPRIO_CLASS_SHIFT) - 1);
+    if (out.io_class == io_class_none) {
+        // No class set: the kernel derives best-effort from the nice value
+        out.io_class = io_class_best_effort;
+        out.io_level = std::clamp((nice + 20) / 5, 0, 7);
+    }
+    return true;
+}
+
+static const char *SignalName(int sig) {
+    switch (sig) {
+    case SIGTERM: return "SIGTERM";
+    case SIGKILL: return "SIGKILL";
+    case SIGSTOP: return "SIGSTOP";
+    case SIGCONT: return "SIGCONT";
+    case SIGHUP: return "SIGHUP";
+    case SIGINT: return "SIGINT";
+    }
+    return "signal";
+}
+
+// "renice: 12 of 14 processes (96 threads), 2 not permitted"
+static std::string FormatResult(const char *what, const BatchResult &result) {
+    std::string line = std::string(what) + ": " + std::to_string(result.applied) + " of " +
+                       std::to_string(result.processes) + " processes";
+    if (result.threads)
+        line += " (" + std::to_string(result.threads) + " threads)";
+    if (result.denied)
+        line += ", " + std::to_string(result.denied) + " not permitted";
+    if (result.gone)
+        line += ", " + std::to_string(result.gone) + " gone";
+    if (result.failed)
+        line += ", " + std::to_string(result.failed) + " failed";
+    return line;
+}
+
+// A CSV field, quoted when it has a comma, quote or newline in it
+static void WriteCsvField(FILE *fp, const char *value) {
+    if (!strpbrk(value, ",\"\n")) {
+        fputs(value, fp);
+        return;
+    }
+    fputc('"', fp);
+    for (const char *c = value; *c; c++) {
+        if (*c == '"')
+            fputc('"', fp);
+        fputc(*c, fp);
+    }
+    fputc('"', fp);
+}
+
+// Only one batch runs at a time; the UI greys its actions out meanwhile
+static std::mutex batch_mtx;
+static std::condition_variable batch_wake;
+static ProcBatch pending;
+static bool batch_pending = false;
+static bool batch_running = false;
+static bool worker_started = false;
+static std::string batch_summary;
+static std::atomic<int> batch_done{0};
+static std::atomic<int> batch_total{0};
+
+static std::string RunBatch(const ProcBatch &batch) {
+    BatchResult result;
+    result.processes = (int)batch.keys.size();
+
+    ProcDir proc_dir;
+    ProcReader reader;
+    reader.proc_fd = proc_dir.Fd();
+    std::function<int(int tid)> change;
+    const char *what = "";
+    switch (batch.action) {
+    case batch_signal:
+        what = SignalName(batch.sig);
+        break;
+    case batch_affinity:
+        what = "affinity";
+        change = [&batch](int tid) {
+            return sched_setaffinity(tid, sizeof(batch.controls.cpus), &batch.controls.cpus);
+        };
+        break;
+    case batch_nice:
+        what = "renice";
+        change = [&batch](int tid) { return setpriority(PRIO_PROCESS, tid, batch.controls.nice); };
+        break;
+    case batch_io_class: {
+        what = "I/O class";
+        const ProcControls &c = batch.controls;
+        int ioprio = (c.io_class << IOPRIO_CLASS_SHIFT) | (c.io_class == io_class_idle ? 0 : c.io_level);
+        change = [ioprio](int tid) { return IoprioSet(tid, ioprio); };
+        break;
+    }
+    case batch_export:
+        what = batch.path.c_str();
+        break;
+    }
+
+    FILE *fp = nullptr;
+    std::unordered_map<int, int> rows; // pid -> snapshot row
+    if (batch.action == batch_export) {
+        fp = fopen(batch.path.c_str(), "w");
+        if (!fp || !batch.snapshot) {
+            std::cerr << "[ERROR] Failed opening " << batch.path << " for the export\n";
+            if (fp)
+                fclose(fp);
+            return "export: can't write " + batch.path;
+        }
+        fputs("pid,ppid,user,name,cpu,mem_kb,threads,io_read,io_write,command\n", fp);
+        for (int row = 0; row < batch.snapshot->Size(); row++)
+            rows[batch.snapshot->pid[row]] = row;
+    }
+
+    for (const ProcKey &key : batch.keys) {
+        if (batch.action == batch_signal) {
+            if (SignalProcess(key.pid, key.start_time, batch.sig))
+                result.applied++;
+            else if (errno == EPERM)
+                result.denied++;
+            else
+                result.gone++;
+        } else if (batch.action == batch_export) {
+            const ProcSnapshot &procs = *batch.snapshot;
+            auto it = rows.find(key.pid);
+            if (it == rows.end() || procs.start_time[it->second] != key.start_time) {
+                result.gone++;
+            } else {
+                int row = it->second;
+                fprintf(fp, "%d,%d,", procs.pid[row], procs.ppid[row]);
+                WriteCsvField(fp, procs.User(row));
+                fputc(',', fp);
+                WriteCsvField(fp, procs.Name(row));
+                fprintf(fp, ",%.1f,%.0f,%d,%.0f,%.0f,", procs.cpu[row], procs.mem[row],
+                        procs.threads[row], procs.io_read[row], procs.io_write[row]);
+                WriteCsvField(fp, procs.Command(row));
+                fputc('\n', fp);
+                result.applied++;
+            }
+        } else {
+            ApplyToThreads(reader, key, change, result);
+        }
+        batch_done.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (fp && fclose(fp) != 0) {
+        std::cerr << "[ERROR] Failed writing " << batch.path << "\n";
+        result.failed = result.applied;
+        result.applied = 0;
+    }
+    return FormatResult(what, result);
+}
+
+static void BatchWorker() {
+    while (!is_finished) {
+        ProcBatch batch;
+        {
+            std::unique_lock<std::mutex> lock(batch_mtx);
+            batch_wake.wait_for(lock, std::chrono::milliseconds(500), [] { return batch_pending; });
+            if (!batch_pending)
+                continue;
+            batch = std::move(pending);
+            batch_pending = false;
+        }
+
+        std::string summary = RunBatch(batch);
+
+        std::lock_guard<std::mutex> lock(batch_mtx);
+        batch_summary = std::move(summary);
+        batch_running = false;
+    }
+}
+
+// Hands the batch to the worker. Returns false, dropping it, while another
+// one is still running.
+bool StartProcBatch(ProcBatch batch) {
+    std::lock_guard<std::mutex> lock(batch_mtx);
+    if (batch_running)
+        return false;
+    if (!worker_started) {
+        std::thread worker(BatchWorker);
+        worker.detach();
+        worker_started = true;
+    }
+    batch_done = 0;
+    batch_total = (int)batch.keys.size();
+    pending = std::move(batch);
+    batch_pending = true;
+    batch_running = true;
+    batch_wake.notify_one();
+    return true;
+}
+
+void GetProcBatchProgress(ProcBatchProgress &out) {
+    std::lock_guard<std::mutex> lock(batch_mtx);
+    out.running = batch_running;
+    out.done = batch_done.load(std::memory_order_relaxed);
+    out.total = batch_total.load(std::memory_order_relaxed);
+    out.summary = batch_summary;
+}
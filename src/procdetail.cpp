@@ -0,0 +1,306 @@
+#include "../punktop.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <functional>
+#include <unistd.h>
+
+// One background loader for the detail pane. The UI asks for a PID, gets
+// nothing back until the loader is done, and then the cached result until
+// that process exits. Reads like /proc/[pid]/maps of a huge JVM only ever
+// stall this thread.
+static std::mutex detail_mtx;
+static std::condition_variable detail_wake;
+static std::unordered_map<int, std::shared_ptr<const ProcDetails>> detail_cache;
+static int requested_pid = 0;
+static unsigned long long requested_start = 0;
+static ProcKey recycled_key = {0, 0}; // exited while loading, not asked for again
+static bool loader_started = false;
+
+// Calls fn for every line of a /proc file, however big, without holding it all
+static bool ForEachLine(const char *path, const std::function<void(const char *, size_t)> &fn) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    static thread_local char buffer[65536];
+    size_t len = 0;
+    ssize_t n;
+    while ((n = read(fd, buffer + len, sizeof(buffer) - len)) > 0) {
+        len += n;
+        size_t start = 0;
+        for (size_t i = 0; i < len; i++) {
+            if (buffer[i] == '\n') {
+                fn(buffer + start, i - start);
+                start = i + 1;
+            }
+        }
+        if (start == 0 && len == sizeof(buffer)) {
+            fn(buffer, len); // line longer than the buffer, cut it
+            start = len;
+        }
+        memmove(buffer, buffer + start, len - start);
+        len -= start;
+    }
+    if (len > 0)
+        fn(buffer, len);
+    close(fd);
+    return true;
+}
+
+static std::string ReadLink(const char *path) {
+    char target[4096];
+    ssize_t n = readlink(path, target, sizeof(target) - 1);
+    if (n < 0)
+        return errno == EACCES ? "(permission denied)" : "(unavailable)";
+    return std::string(target, n);
+}
+
+// environ is NUL separated and can be any size
+static void ReadEnviron(const char *path, ProcDetails &details) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        details.environ_error = errno == EACCES ? "permission denied" : "unavailable";
+        return;
+    }
+    std::string all;
+    char buffer[16384];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+        all.append(buffer, n);
+    close(fd);
+
+    for (size_t start = 0; start < all.size();) {
+        size_t end = all.find('\0', start);
+        if (end == std::string::npos)
+            end = all.size();
+        if (end > start)
+            details.environ.emplace_back(all, start, end - start);
+        start = end + 1;
+    }
+}
+
+// "start-end perms offset dev inode path": sizes per kind and per file
+static void SummarizeMaps(const char *path, ProcDetails &details) {
+    std::unordered_map<std::string, unsigned long long> file_kb;
+    bool ok = ForEachLine(path, [&](const char *line, size_t len) {
+        unsigned long long start = 0, end = 0;
+        if (sscanf(line, "%llx-%llx", &start, &end) != 2)
+            return;
+        unsigned long long kb = (end - start) / 1024;
+        details.maps.mappings++;
+        details.maps.total_kb += kb;
+
+        // The path is the 6th field, if there is one
+        const char *p = line, *line_end = line + len;
+        for (int field = 0; field < 5 && p < line_end; field++) {
+            while (p < line_end && *p != ' ')
+                p++;
+            while (p < line_end && *p == ' ')
+                p++;
+        }
+        std::string name(p, line_end);
+        if (name.empty())
+            details.maps.anon_kb += kb;
+        else if (name == "[heap]")
+            details.maps.heap_kb += kb;
+        else if (name.compare(0, 6, "[stack") == 0)
+            details.maps.stack_kb += kb;
+        else if (name[0] == '/') {
+            details.maps.file_kb += kb;
+            file_kb[name] += kb;
+        } else
+            details.maps.other_kb += kb;
+    });
+    if (!ok) {
+        details.maps.error = errno == EACCES ? "permission denied" : "unavailable";
+        return;
+    }
+
+    details.maps.largest_files.assign(file_kb.begin(), file_kb.end());
+    size_t keep = std::min<size_t>(details.maps.largest_files.size(), 8);
+    std::partial_sort(details.maps.largest_files.begin(),
+                      details.maps.largest_files.begin() + keep,
+                      details.maps.largest_files.end(),
+                      [](const auto &a, const auto &b) { return a.second > b.second; });
+    details.maps.largest_files.resize(keep);
+}
+
+static int CountFds(const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir)
+        return -1;
+    int count = 0;
+    while (struct dirent *entry = readdir(dir))
+        if (entry->d_name[0] != '.')
+            count++;
+    closedir(dir);
+    return count;
+}
+
+static std::shared_ptr<ProcDetails> LoadProcDetails(int pid, unsigned long long start_time) {
+    auto details = std::make_shared<ProcDetails>();
+    details->pid = pid;
+    details->start_time = start_time;
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/exe", pid);
+    details->exe = ReadLink(path);
+    snprintf(path, sizeof(path), "/proc/%d/cwd", pid);
+    details->cwd = ReadLink(path);
+
+    snprintf(path, sizeof(path), "/proc/%d/environ", pid);
+    ReadEnviron(path, *details);
+
+    snprintf(path, sizeof(path), "/proc/%d/limits", pid);
+    ForEachLine(path, [&](const char *line, size_t len) {
+        details->limits.emplace_back(line, len);
+    });
+
+    snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+    SummarizeMaps(path, *details);
+
+    snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+    details->fd_count = CountFds(path);
+
+    snprintf(path, sizeof(path), "/proc/%d/cgroup", pid);
+    ForEachLine(path, [&](const char *line, size_t len) {
+        details->cgroups.emplace_back(line, len);
+    });
+
+    static const char *namespaces[] = {"cgroup", "ipc", "mnt", "net", "pid", "time", "user", "uts"};
+    for (const char *ns : namespaces) {
+        snprintf(path, sizeof(path), "/proc/%d/ns/%s", pid, ns);
+        details->namespaces.emplace_back(ns, ReadLink(path));
+    }
+    return details;
+}
+
+static void DetailLoader() {
+    ProcDir proc_dir;
+    ProcReader reader;
+    reader.proc_fd = proc_dir.Fd();
+    while (!is_finished) {
+        int pid;
+        unsigned long long start_time;
+        {
+            std::unique_lock<std::mutex> lock(detail_mtx);
+            detail_wake.wait_for(lock, std::chrono::milliseconds(500),
+                                 [] { return requested_pid != 0; });
+            if (requested_pid == 0)
+                continue;
+            pid = requested_pid;
+            start_time = requested_start;
+        }
+
+        std::shared_ptr<ProcDetails> details = LoadProcDetails(pid, start_time);
+
+        // The files were read by PID. If stat is gone or shows another start
+        // time, the process exited and its PID may have been recycled on the
+        // way, so some of them can be another process's: nothing is kept.
+        ProcSample sample;
+        bool same = reader.Read(pid, sample) && sample.start_time == start_time;
+
+        std::lock_guard<std::mutex> lock(detail_mtx);
+        if (same)
+            detail_cache[pid] = std::move(details);
+        else
+            recycled_key = {pid, start_time};
+        // A newer request may have come in meanwhile; keep it
+        if (requested_pid == pid && requested_start == start_time)
+            requested_pid = 0;
+    }
+}
+
+// Cached details for the process, or null while they are being loaded.
+// Only the latest request is kept, so clicking through rows never queues up.
+std::shared_ptr<const ProcDetails> GetProcDetails(int pid, unsigned long long start_time) {
+    std::lock_guard<std::mutex> lock(detail_mtx);
+    auto it = detail_cache.find(pid);
+    if (it != detail_cache.end() && it->second->start_time == start_time)
+        return it->second;
+
+    if (!loader_started) {
+        std::thread loader(DetailLoader);
+        loader.detach();
+        loader_started = true;
+    }
+    if (recycled_key == ProcKey{pid, start_time})
+        return nullptr;
+    if (requested_pid != pid || requested_start != start_time) {
+        requested_pid = pid;
+        requested_start = start_time;
+        detail_wake.notify_one();
+    }
+    return nullptr;
+}
+
+// Forgets the details of processes that are gone
+void PruneProcDetails(const ProcSnapshot &snapshot) {
+    std::lock_guard<std::mutex> lock(detail_mtx);
+    for (auto it = detail_cache.begin(); it != detail_cache.end();) {
+        auto row = std::find(snapshot.pid.begin(), snapshot.pid.end(), it->first);
+        if (row == snapshot.pid.end() ||
+            snapshot.start_time[row - snapshot.pid.begin()] != it->second->start_time)
+            it = detail_cache.erase(it);
+        else
+            ++it;
+    }
+}
+
+// Tab items for the detail pane; the caller owns the tab bar
+void ShowProcDetails(const ProcDetails &details) {
+    if (ImGui::BeginTabItem("Files")) {
+        ImGui::Text("exe: %s", details.exe.c_str());
+        ImGui::Text("cwd: %s", details.cwd.c_str());
+        if (details.fd_count >= 0)
+            ImGui::Text("open fds: %d", details.fd_count);
+        else
+            ImGui::TextDisabled("open fds: unavailable");
+        ImGui::EndTabItem();
+    }
+
+    if (ImGui::BeginTabItem("Environment")) {
+        if (!details.environ_error.empty())
+            ImGui::TextDisabled("%s", details.environ_error.c_str());
+        ImGuiListClipper clipper;
+        clipper.Begin((int)details.environ.size());
+        while (clipper.Step())
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+                ImGui::TextUnformatted(details.environ[i].c_str());
+        ImGui::EndTabItem();
+    }
+
+    if (ImGui::BeginTabItem("Limits")) {
+        for (const std::string &line : details.limits)
+            ImGui::TextUnformatted(line.c_str());
+        ImGui::EndTabItem();
+    }
+
+    if (ImGui::BeginTabItem("Memory Map")) {
+        const ProcDetails::MapsSummary &maps = details.maps;
+        if (!maps.error.empty()) {
+            ImGui::TextDisabled("%s", maps.error.c_str());
+        } else {
+            ImGui::Text("%zu mappings, %.1f MB mapped", maps.mappings, maps.total_kb / 1024.0);
+            ImGui::Text("files %.1f MB, anonymous %.1f MB, heap %.1f MB, stacks %.1f MB, other %.1f MB",
+                        maps.file_kb / 1024.0, maps.anon_kb / 1024.0, maps.heap_kb / 1024.0,
+                        maps.stack_kb / 1024.0, maps.other_kb / 1024.0);
+            ImGui::SeparatorText("Largest files");
+            for (const auto &[file, kb] : maps.largest_files)
+                ImGui::Text("%9.1f MB  %s", kb / 1024.0, file.c_str());
+        }
+        ImGui::EndTabItem();
+    }
+
+    if (ImGui::BeginTabItem("Cgroups & Namespaces")) {
+        for (const std::string &line : details.cgroups)
+            ImGui::TextUnformatted(line.c_str());
+        ImGui::Separator();
+        for (const auto &[ns, target] : details.namespaces)
+            ImGui::Text("%-6s %s", ns.c_str(), target.c_str());
+        ImGui::EndTabItem();
+    }
+}
@@ -0,0 +1,246 @@
+#include "../punktop.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <stdio.h>
+
+// Field names the query language knows, and whether they compare as numbers
+static const struct {
+    const char *name;
+    ProcFilter::Field field;
+    bool numeric;
+} filter_fields[] = {
+    {"name", ProcFilter::field_name, false},
+    {"user", ProcFilter::field_user, false},
+    {"cmd", ProcFilter::field_cmd, false},
+    {"pid", ProcFilter::field_pid, true},
+    {"ppid", ProcFilter::field_ppid, true},
+    {"cpu", ProcFilter::field_cpu, true},
+    {"mem", ProcFilter::field_mem, true},
+    {"threads", ProcFilter::field_threads, true},
+    {"subcpu", ProcFilter::field_subtree_cpu, true},
+    {"submem", ProcFilter::field_subtree_mem, true},
+    {"minflt", ProcFilter::field_minflt, true},
+    {"majflt", ProcFilter::field_majflt, true},
+    {"vcsw", ProcFilter::field_vcsw, true},
+    {"nvcsw", ProcFilter::field_nvcsw, true},
+};
+
+static std::string Lowered(std::string str) {
+    for (char &c : str)
+        c = (char)tolower((unsigned char)c);
+    return str;
+}
+
+bool ProcFilter::Compile(const std::string &query) {
+    terms.clear();
+    error.clear();
+
+    const char *p = query.c_str();
+    while (true) {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (!*p)
+            break;
+
+        Term term;
+        // "--port" is a word to look for, not "not -port"
+        if (*p == '-' && p[1] && p[1] != ' ' && p[1] != '\t' && p[1] != '-') {
+            term.negate = true;
+            p++;
+        }
+
+        // field, then an operator; a token without one is a plain word
+        const char *key = p;
+        while (isalpha((unsigned char)*p))
+            p++;
+        size_t key_len = p - key;
+        bool has_op = key_len > 0 && strchr(":~<>=", *p) && *p;
+        if (!has_op) {
+            p = key;
+            term.field = field_any;
+        } else {
+            bool known = false, numeric = false;
+            for (const auto &f : filter_fields) {
+                if (strlen(f.name) == key_len && strncmp(f.name, key, key_len) == 0) {
+                    term.field = f.field;
+                    numeric = f.numeric;
+                    known = true;
+                }
+            }
+            if (!known) {
+                error = "unknown field '" + std::string(key, key_len) + "'";
+                terms.clear();
+                return false;
+            }
+
+            if (*p == '<' || *p == '>') {
+                bool less = *p++ == '<';
+                bool or_equal = *p == '=';
+                if (or_equal)
+                    p++;
+                term.op = less ? (or_equal ? op_less_eq : op_less)
+                               : (or_equal ? op_greater_eq : op_greater);
+            } else {
+                term.op = *p++ == '~' ? op_contains : op_equals;
+            }
+            bool valid_op = numeric ? term.op != op_contains
+                                    : term.op == op_equals || term.op == op_contains;
+            if (!valid_op) {
+                error = "'" + std::string(key, key_len) + "' can't be compared that way";
+                terms.clear();
+                return false;
+            }
+        }
+
+        // value, optionally quoted
+        std::string value;
+        if (*p == '"') {
+            const char *end = strchr(++p, '"');
+            if (!end) {
+                error = "missing closing quote";
+                terms.clear();
+                return false;
+            }
+            value.assign(p, end);
+            p = end + 1;
+        } else {
+            const char *start = p;
+            while (*p && *p != ' ' && *p != '\t')
+                p++;
+            value.assign(start, p);
+        }
+        if (value.empty()) {
+            error = "missing value";
+            terms.clear();
+            return false;
+        }
+
+        bool numeric_field = term.field >= field_pid;
+        if (numeric_field) {
+            char *end;
+            term.number = strtod(value.c_str(), &end);
+            if (*end) {
+                error = "'" + value + "' is not a number";
+                terms.clear();
+                return false;
+            }
+        } else {
+            term.text = Lowered(value);
+            term.digits = term.text.find_first_not_of("0123456789") == std::string::npos;
+        }
+        terms.push_back(std::move(term));
+    }
+    return true;
+}
+
+// Memoized per string id, so each distinct string is searched once per term
+bool ProcFilter::MatchText(size_t term_index, uint32_t id, size_t id_count) {
+    signed char &memo = text_matches[term_index * id_count + id];
+    if (memo < 0) {
+        const Term &term = terms[term_index];
+        const char *haystack = lowered.data() + snapshot_offsets[id];
+        memo = term.op == op_equals ? term.text == haystack
+                                    : strstr(haystack, term.text.c_str()) != nullptr;
+    }
+    return memo != 0;
+}
+
+void ProcFilter::Apply(const ProcSnapshot &snapshot, const std::pmr::vector<int32_t> &rows,
+                       std::vector<int> &out) {
+    out.clear();
+    if (terms.empty()) {
+        out.assign(rows.begin(), rows.end());
+        return;
+    }
+
+    // Lowercase copy of the whole string pool, once per snapshot
+    if (lowered_generation != snapshot.generation) {
+        lowered.resize(snapshot.strings.chars.size());
+        for (size_t i = 0; i < lowered.size(); i++)
+            lowered[i] = (char)tolower((unsigned char)snapshot.strings.chars[i]);
+        lowered_generation = snapshot.generation;
+    }
+    snapshot_offsets = snapshot.strings.offsets.data();
+    size_t id_count = snapshot.strings.offsets.size();
+    text_matches.assign(terms.size() * id_count, -1);
+
+    auto matches = [&](size_t t, int row) {
+        const Term &term = terms[t];
+        double value;
+        switch (term.field) {
+        case field_any: {
+            if (MatchText(t, snapshot.name_id[row], id_count) ||
+                MatchText(t, snapshot.command_id[row], id_count))
+                return true;
+            if (!term.digits)
+                return false;
+            char pid_str[16];
+            snprintf(pid_str, sizeof(pid_str), "%d", snapshot.pid[row]);
+            return strstr(pid_str, term.text.c_str()) != nullptr;
+        }
+        case field_name:
+            return MatchText(t, snapshot.name_id[row], id_count);
+        case field_user:
+            return MatchText(t, snapshot.user_id[row], id_count);
+        case field_cmd:
+            return MatchText(t, snapshot.command_id[row], id_count);
+        case field_pid:
+            value = snapshot.pid[row];
+            break;
+        case field_ppid:
+            value = snapshot.ppid[row];
+            break;
+        case field_cpu:
+            value = snapshot.cpu[row];
+            break;
+        case field_mem:
+            value = snapshot.mem[row] / 1024.0; // MB, like the column
+            break;
+        case field_threads:
+            value = snapshot.threads[row];
+            break;
+        case field_subtree_cpu:
+            value = snapshot.subtree_cpu[row];
+            break;
+        case field_subtree_mem:
+            value = snapshot.subtree_mem[row] / 1024.0;
+            break;
+        case field_minflt:
+            value = snapshot.minflt[row];
+            break;
+        case field_majflt:
+            value = snapshot.majflt[row];
+            break;
+        case field_vcsw:
+            value = snapshot.vcsw[row];
+            break;
+        case field_nvcsw:
+            value = snapshot.nvcsw[row];
+            break;
+        default:
+            return false;
+        }
+
+        switch (term.op) {
+        case op_less:
+            return value < term.number;
+        case op_less_eq:
+            return value <= term.number;
+        case op_greater:
+            return value > term.number;
+        case op_greater_eq:
+            return value >= term.number;
+        default:
+            return value == term.number;
+        }
+    };
+
+    for (int row : rows) {
+        bool keep = true;
+        for (size_t t = 0; t < terms.size() && keep; t++)
+            keep = matches(t, row) != terms[t].negate;
+        if (keep)
+            out.push_back(row);
+    }
+}
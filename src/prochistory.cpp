@@ -0,0 +1,154 @@
+#include "../include/implot/implot.h"
+#include "../punktop.h"
+#include <algorithm>
+
+// Fixed ring of the last PROC_HISTORY_SIZE samples of one process
+struct ProcHistory {
+    unsigned long long start_time = 0; // tells a recycled PID apart
+    unsigned long long last_used = 0;  // use_clock of the last UI read, for LRU
+    unsigned long long last_scan = 0;  // generation of the last sample
+    int head = 0;                      // next slot to write
+    int count = 0;
+    float cpu[PROC_HISTORY_SIZE];
+    float mem[PROC_HISTORY_SIZE]; // MB
+    float threads[PROC_HISTORY_SIZE];
+};
+
+static std::mutex history_mtx;
+static std::unordered_map<int, ProcHistory> histories;
+static WantedPids wanted; // asked for by the UI but not tracked, because of the cap
+static unsigned long long use_clock = 0;
+
+static const size_t max_histories = PROC_HISTORY_MAX_BYTES / sizeof(ProcHistory);
+
+// Drops the ring the UI has not looked at for the longest
+static void EvictLeastRecentlyUsed() {
+    auto victim = histories.end();
+    for (auto it = histories.begin(); it != histories.end(); ++it)
+        if (victim == histories.end() || it->second.last_used < victim->second.last_used)
+            victim = it;
+    if (victim != histories.end())
+        histories.erase(victim);
+}
+
+// Called by the sampler once per published snapshot. Every process gets a
+// ring while there is room; past the cap only the ones the UI asked for
+// get one, in place of the least recently viewed.
+void RecordProcHistory(const ProcSnapshot &snapshot) {
+    static std::unordered_map<int, unsigned long long> requests;
+    wanted.Take(requests);
+    std::lock_guard<std::mutex> lock(history_mtx);
+
+    for (int row = 0; row < snapshot.Size(); row++) {
+        int pid = snapshot.pid[row];
+        auto it = histories.find(pid);
+        if (it != histories.end() && it->second.start_time != snapshot.start_time[row]) {
+            histories.erase(it); // PID was recycled
+            it = histories.end();
+        }
+        if (it == histories.end()) {
+            if (histories.size() >= max_histories) {
+                auto request = requests.find(pid);
+                if (request == requests.end() || request->second != snapshot.start_time[row])
+                    continue;
+                EvictLeastRecentlyUsed();
+            }
+            it = histories.try_emplace(pid).first;
+            it->second.start_time = snapshot.start_time[row];
+            it->second.last_used = use_clock;
+        }
+
+        ProcHistory &history = it->second;
+        history.cpu[history.head] = snapshot.cpu[row];
+        history.mem[history.head] = snapshot.mem[row] / 1024.0f;
+        history.threads[history.head] = (float)snapshot.threads[row];
+        history.head = (history.head + 1) % PROC_HISTORY_SIZE;
+        history.count = std::min(history.count + 1, PROC_HISTORY_SIZE);
+        history.last_scan = snapshot.generation;
+    }
+
+    // Processes that are gone (or not in a top-N snapshot) lose their ring
+    for (auto it = histories.begin(); it != histories.end();) {
+        if (it->second.last_scan != snapshot.generation)
+            it = histories.erase(it);
+        else
+            ++it;
+    }
+}
+
+// Copies a process's history out, oldest first. Counts as a use for the LRU.
+bool GetProcHistory(int pid, unsigned long long start_time, ProcHistoryView &out) {
+    std::lock_guard<std::mutex> lock(history_mtx);
+    auto it = histories.find(pid);
+    if (it == histories.end() || it->second.start_time != start_time) {
+        wanted.Want(pid, start_time);
+        out.count = 0;
+        return false;
+    }
+
+    ProcHistory &history = it->second;
+    history.last_used = ++use_clock;
+    out.count = history.count;
+    int start = (history.head - history.count + PROC_HISTORY_SIZE) % PROC_HISTORY_SIZE;
+    for (int i = 0; i < history.count; i++) {
+        int slot = (start + i) % PROC_HISTORY_SIZE;
+        out.cpu[i] = history.cpu[slot];
+        out.mem[i] = history.mem[slot];
+        out.threads[i] = history.threads[slot];
+    }
+    return true;
+}
+
+size_t ProcHistoryBytes() {
+    std::lock_guard<std::mutex> lock(history_mtx);
+    return histories.size() * sizeof(ProcHistory);
+}
+
+// Tiny axis-less line plot for a table cell
+void ShowSparkline(const char *id, const float *values, int count, float max_value,
+                   const ImVec4 &color, const ImVec2 &size) {
+    ImPlot::PushStyleVar(ImPlotStyleVar_PlotPadding, ImVec2(0, 0));
+    if (ImPlot::BeginPlot(id, size, ImPlotFlags_CanvasOnly | ImPlotFlags_NoInputs)) {
+        ImPlot::SetupAxes(nullptr, nullptr, ImPlotAxisFlags_NoDecorations,
+                          ImPlotAxisFlags_NoDecorations);
+        ImPlot::SetupAxesLimits(0, PROC_HISTORY_SIZE - 1, 0, max_value, ImGuiCond_Always);
+        ImPlot::SetNextLineStyle(color);
+        ImPlot::SetNextFillStyle(color, 0.25f);
+        // Right-aligned, so the newest sample is always at the right edge
+        ImPlot::PlotLine(id, values, count, 1.0, PROC_HISTORY_SIZE - count, ImPlotLineFlags_Shaded);
+        ImPlot::EndPlot();
+    }
+    ImPlot::PopStyleVar();
+}
+
+// Full chart for the detail pane: CPU on the left axis, memory and threads on the right
+void ShowProcHistoryPlot(const ProcHistoryView &history, float height) {
+    if (history.count == 0) {
+        ImGui::TextDisabled("No history yet");
+        return;
+    }
+
+    static float seconds_ago[PROC_HISTORY_SIZE];
+    for (int i = 0; i < history.count; i++)
+        seconds_ago[i] = -(history.count - 1 - i) * (PROC_REFRESH_MS / 1000.0f);
+
+    if (ImPlot::BeginPlot("##ProcHistory", ImVec2(-1, height), ImPlotFlags_NoTitle)) {
+        ImPlot::SetupAxes("Seconds ago", "% CPU");
+        ImPlot::SetupAxis(ImAxis_Y2, "Mem (MB)", ImPlotAxisFlags_AuxDefault | ImPlotAxisFlags_AutoFit);
+        ImPlot::SetupAxis(ImAxis_Y3, "Threads", ImPlotAxisFlags_AuxDefault | ImPlotAxisFlags_AutoFit);
+        ImPlot::SetupAxisLimits(ImAxis_X1, -(PROC_HISTORY_SIZE - 1) * (PROC_REFRESH_MS / 1000.0), 0,
+                                ImGuiCond_Always);
+        ImPlot::SetupAxisLimits(ImAxis_Y1, 0, 100, ImGuiCond_Once);
+
+        ImPlot::SetAxes(ImAxis_X1, ImAxis_Y1);
+        ImPlot::SetNextLineStyle(ImVec4(0.9f, 0.3f, 0.3f, 1.0f));
+        ImPlot::PlotLine("CPU", seconds_ago, history.cpu, history.count);
+        ImPlot::SetAxes(ImAxis_X1, ImAxis_Y2);
+        ImPlot::SetNextLineStyle(ImVec4(0.3f, 0.7f, 0.9f, 1.0f));
+        ImPlot::PlotLine("Mem", seconds_ago, history.mem, history.count);
+        ImPlot::SetAxes(ImAxis_X1, ImAxis_Y3);
+        ImPlot::SetNextLineStyle(ImVec4(0.8f, 0.8f, 0.4f, 1.0f));
+        ImPlot::PlotLine("Threads", seconds_ago, history.threads, history.count);
+        ImPlot::EndPlot();
+    }
+}
@@ -0,0 +1,71 @@
+#include "../punktop.h"
+#include <chrono>
+
+// PSS/USS/Swap for the processes the UI is showing, read from smaps_rollup
+// for the wanted set after a scan, each at most every PROC_MEMORY_REFRESH_MS
+struct MemorySample {
+    unsigned long long start_time = 0;
+    ProcMemory memory;
+    std::chrono::steady_clock::time_point sampled_at;
+    unsigned long long wanted_scan = 0; // generation it was last asked for in
+};
+
+static std::mutex memory_mtx;
+static std::unordered_map<int, MemorySample> samples;
+static WantedPids wanted;
+
+static const unsigned long long keep_scans = 15; // unwatched samples kept this long, for scrolling back
+
+void SampleProcMemory(const ProcSnapshot &snapshot, ProcReader &reader) {
+    static std::unordered_map<int, unsigned long long> requests;
+    wanted.Take(requests);
+
+    auto now = std::chrono::steady_clock::now();
+    auto refresh = std::chrono::milliseconds(PROC_MEMORY_REFRESH_MS);
+    for (const auto &[pid, start_time] : requests) {
+        {
+            std::lock_guard<std::mutex> lock(memory_mtx);
+            auto it = samples.find(pid);
+            if (it != samples.end() && it->second.start_time == start_time) {
+                it->second.wanted_scan = snapshot.generation;
+                if (now - it->second.sampled_at < refresh)
+                    continue;
+            }
+        }
+
+        // Read without the lock; this is the slow part
+        ProcMemory memory;
+        reader.ReadMemory(pid, memory);
+        // The PID may have been recycled since the request; don't file a stranger's memory
+        ProcSample check;
+        if (!reader.Read(pid, check) || check.start_time != start_time)
+            continue;
+
+        std::lock_guard<std::mutex> lock(memory_mtx);
+        MemorySample &sample = samples[pid];
+        sample.start_time = start_time;
+        sample.memory = memory;
+        sample.sampled_at = now;
+        sample.wanted_scan = snapshot.generation;
+    }
+
+    std::lock_guard<std::mutex> lock(memory_mtx);
+    for (auto it = samples.begin(); it != samples.end();) {
+        if (snapshot.generation - it->second.wanted_scan > keep_scans)
+            it = samples.erase(it);
+        else
+            ++it;
+    }
+}
+
+// Latest sample for the process, if there is one. Also asks for the next.
+bool GetProcMemory(int pid, unsigned long long start_time, ProcMemory &out) {
+    wanted.Want(pid, start_time);
+    std::lock_guard<std::mutex> lock(memory_mtx);
+
+    auto it = samples.find(pid);
+    if (it == samples.end() || it->second.start_time != start_time)
+        return false;
+    out = it->second.memory;
+    return true;
+}
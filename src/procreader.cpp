@@ -0,0 +1,334 @@
+#include "../punktop.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// Writes "<pid>/<file>" for openat() relative to the /proc fd, without snprintf
+static void PidPath(char *out, int pid, const char *file) {
+    char digits[12];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + pid % 10);
+        pid /= 10;
+    } while (pid);
+    while (n)
+        *out++ = digits[--n];
+    *out++ = '/';
+    while ((*out++ = *file++))
+        ;
+}
+
+ProcDir::ProcDir() {
+    fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+ProcDir::~ProcDir() {
+    if (fd >= 0)
+        close(fd);
+}
+
+// Directory entries from one getdents64 call whose name is all digits:
+// PIDs in /proc, TIDs in /proc/[pid]/task. The number is parsed on the way.
+static void AddNumberedDirs(const char *buffer, ssize_t n, std::vector<int> &out) {
+    for (ssize_t pos = 0; pos < n;) {
+        const struct dirent64 *entry = (const struct dirent64 *)(buffer + pos);
+        pos += entry->d_reclen;
+        if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN)
+            continue;
+
+        const char *c = entry->d_name;
+        if (*c < '1' || *c > '9')
+            continue;
+        int id = 0;
+        while (*c >= '0' && *c <= '9')
+            id = id * 10 + (*c++ - '0');
+        if (*c == '\0')
+            out.push_back(id);
+    }
+}
+
+// Walks /proc with getdents64 into the reusable buffer
+bool ProcDir::ListPids(std::vector<int> &pids) {
+    pids.clear();
+    if (fd < 0)
+        return false;
+    lseek(fd, 0, SEEK_SET);
+    syscalls++;
+
+    ssize_t n;
+    while ((n = getdents64(fd, buffer, sizeof(buffer))) > 0) {
+        syscalls++;
+        AddNumberedDirs(buffer, n, pids);
+    }
+    syscalls++; // the final call that returned 0
+    return n == 0;
+}
+
+// Reads a whole /proc file into the shared buffer with raw openat/read/close,
+// path being relative to /proc. procfs hands back small seq files in one
+// read, so a short read means EOF. Some files (io, smaps_rollup) check
+// permissions on read rather than on open; either way -1 leaves errno set.
+int ProcReader::ReadFile(const char *path) {
+    int fd = openat(proc_fd, path, O_RDONLY | O_CLOEXEC);
+    syscalls++;
+    if (fd < 0)
+        return -1;
+
+    size_t len = 0;
+    int error = 0;
+    while (len < sizeof(buffer) - 1) {
+        ssize_t n = read(fd, buffer + len, sizeof(buffer) - 1 - len);
+        syscalls++;
+        if (n <= 0) {
+            error = n < 0 ? errno : 0;
+            break;
+        }
+        len += n;
+        if (len < sizeof(buffer) - 1)
+            break;
+    }
+    close(fd);
+    syscalls++;
+
+    buffer[len] = '\0';
+    if (len == 0 && error) {
+        errno = error;
+        return -1;
+    }
+    return (int)len;
+}
+
+// /proc/[pid]/stat: pid (comm) state ppid ... minflt ... majflt ... utime stime
+// ... num_threads ... starttime
+static bool ParseStat(const char *buf, ProcSample &out) {
+    // comm can contain spaces and parens, the real end is the last ')'
+    const char *p = strrchr(buf, ')');
+    if (!p || p[1] != ' ')
+        return false;
+    p += 2;
+    out.state = *p++;
+
+    // Fields are numbered from 1 like in proc(5); state was field 3
+    unsigned long long fields[23] = {0};
+    for (int field = 4; field < 23; field++) {
+        char *end;
+        fields[field] = strtoull(p, &end, 10);
+        if (end == p)
+            return false;
+        p = end;
+    }
+    out.ppid = (int)fields[4];
+    out.minflt = fields[10];
+    out.majflt = fields[12];
+    out.utime = fields[14];
+    out.stime = fields[15];
+    out.threads = (int)fields[20];
+    out.start_time = fields[22];
+    return true;
+}
+
+// /proc/[pid]/status: only the "Key:\tvalue" lines we care about
+static void ParseStatus(const char *buf, ProcSample &out) {
+    for (const char *line = buf; *line;) {
+        const char *eol = strchr(line, '\n');
+        size_t len = eol ? (size_t)(eol - line) : strlen(line);
+
+        if (strncmp(line, "Name:", 5) == 0) {
+            const char *v = line + 5;
+            while (*v == ' ' || *v == '\t')
+                v++;
+            size_t n = std::min((size_t)(line + len - v), sizeof(out.name) - 1);
+            memcpy(out.name, v, n);
+            out.name[n] = '\0';
+        } else if (strncmp(line, "Uid:", 4) == 0) {
+            // real, effective, saved, fs -- the owner of /proc/[pid] is the effective one
+            unsigned ruid = 0, euid = 0;
+            if (sscanf(line + 4, "%u %u", &ruid, &euid) == 2)
+                out.uid = euid;
+        } else if (strncmp(line, "VmRSS:", 6) == 0) {
+            out.rss_kb = strtol(line + 6, nullptr, 10);
+        } else if (strncmp(line, "voluntary_ctxt_switches:", 24) == 0) {
+            out.vcsw = strtoull(line + 24, nullptr, 10);
+        } else if (strncmp(line, "nonvoluntary_ctxt_switches:", 27) == 0) {
+            out.nvcsw = strtoull(line + 27, nullptr, 10);
+        }
+
+        if (!eol)
+            break;
+        line = eol + 1;
+    }
+}
+
+bool ProcReader::Read(int pid, ProcSample &out) {
+    char path[32];
+    out = ProcSample{};
+
+    PidPath(path, pid, "stat");
+    if (ReadFile(path) <= 0 || !ParseStat(buffer, out))
+        return false;
+
+    // A process can exit between the two reads; keep what stat gave us
+    PidPath(path, pid, "status");
+    if (ReadFile(path) > 0)
+        ParseStatus(buffer, out);
+    if (out.name[0] == '\0')
+        strcpy(out.name, "{Unknown}");
+    return true;
+}
+
+std::string ProcReader::ReadCommand(int pid) {
+    char path[32];
+    PidPath(path, pid, "cmdline");
+    int fd = openat(proc_fd, path, O_RDONLY | O_CLOEXEC);
+    syscalls++;
+    if (fd < 0)
+        return "{Unknown}";
+
+    // cmdline can be longer than the buffer, keep reading until EOF
+    std::string cmd;
+    ssize_t n;
+    do {
+        n = read(fd, buffer, sizeof(buffer));
+        syscalls++;
+        for (ssize_t i = 0; i < n; i++)
+            cmd += (buffer[i] == '\0') ? ' ' : buffer[i];
+    } while (n > 0);
+    close(fd);
+    syscalls++;
+    return cmd.empty() ? "{Unknown}" : cmd;
+}
+
+// /proc/[pid]/task, the same way ProcDir lists /proc
+bool ProcReader::ListTasks(int pid, std::vector<int> &tids) {
+    char path[32];
+    tids.clear();
+    PidPath(path, pid, "task");
+    int fd = openat(proc_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    syscalls++;
+    if (fd < 0)
+        return false;
+
+    ssize_t n;
+    while ((n = getdents64(fd, buffer, sizeof(buffer))) > 0) {
+        syscalls++;
+        AddNumberedDirs(buffer, n, tids);
+    }
+    syscalls++;
+    close(fd);
+    syscalls++;
+    return n == 0;
+}
+
+// /proc/[pid]/task/[tid]/stat. The comm between the parens is the thread
+// name, the same as task/[tid]/comm, so no second file is read.
+bool ProcReader::ReadTask(int pid, int tid, ProcSample &out) {
+    char path[48];
+    out = ProcSample{};
+    PidPath(path, pid, "task/");
+    PidPath(path + strlen(path), tid, "stat");
+    if (ReadFile(path) <= 0 || !ParseStat(buffer, out))
+        return false;
+
+    const char *name_start = strchr(buffer, '(') + 1; // ParseStat found the ')'
+    const char *name_end = strrchr(buffer, ')');
+    size_t n = std::min((size_t)(name_end - name_start), sizeof(out.name) - 1);
+    memcpy(out.name, name_start, n);
+    out.name[n] = '\0';
+    return true;
+}
+
+// /proc/[pid]/io: "key: value" lines. rchar/wchar count page cache hits
+// too; read_bytes/write_bytes are what reached the block layer. On failure
+// errno is the openat/read error, or 0 if the file came back empty.
+bool ProcReader::ReadIo(int pid, ProcSample &out) {
+    char path[32];
+    PidPath(path, pid, "io");
+    out.io = false;
+    int len = ReadFile(path);
+    if (len <= 0) {
+        if (len == 0)
+            errno = 0; // not an error, so no stale EACCES either
+        return false;
+    }
+
+    for (const char *line = buffer; *line;) {
+        const char *eol = strchr(line, '\n');
+        if (strncmp(line, "syscr:", 6) == 0)
+            out.syscr = strtoull(line + 6, nullptr, 10);
+        else if (strncmp(line, "syscw:", 6) == 0)
+            out.syscw = strtoull(line + 6, nullptr, 10);
+        else if (strncmp(line, "read_bytes:", 11) == 0)
+            out.read_bytes = strtoull(line + 11, nullptr, 10);
+        else if (strncmp(line, "write_bytes:", 12) == 0)
+            out.write_bytes = strtoull(line + 12, nullptr, 10);
+        if (!eol)
+            break;
+        line = eol + 1;
+    }
+    out.io = true;
+    return true;
+}
+
+// /proc/[pid]/smaps_rollup: one header line, then "Key:   value kB" lines
+// summed over every mapping. USS is the private part of the RSS.
+bool ProcReader::ReadMemory(int pid, ProcMemory &out) {
+    char path[32];
+    out = ProcMemory{};
+    PidPath(path, pid, "smaps_rollup");
+    if (ReadFile(path) <= 0)
+        return false;
+
+    for (const char *line = buffer; *line;) {
+        const char *eol = strchr(line, '\n');
+        if (strncmp(line, "Pss:", 4) == 0)
+            out.pss_kb = strtol(line + 4, nullptr, 10);
+        else if (strncmp(line, "Private_Clean:", 14) == 0)
+            out.uss_kb += strtol(line + 14, nullptr, 10);
+        else if (strncmp(line, "Private_Dirty:", 14) == 0)
+            out.uss_kb += strtol(line + 14, nullptr, 10);
+        else if (strncmp(line, "Swap:", 5) == 0)
+            out.swap_kb = strtol(line + 5, nullptr, 10);
+        if (!eol)
+            break;
+        line = eol + 1;
+    }
+    out.readable = true;
+    return true;
+}
+
+const std::string &UserCache::Lookup(unsigned uid) {
+    // Entries are never erased while workers run, so the reference stays valid
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = names.find(uid);
+    if (it != names.end())
+        return it->second;
+
+    struct passwd pw, *result = nullptr;
+    char buf[1024];
+    getpwuid_r(uid, &pw, buf, sizeof(buf), &result);
+    std::string name = result ? result->pw_name : std::to_string(uid);
+    return names.emplace(uid, std::move(name)).first->second;
+}
+
+void UserCache::Revalidate() {
+    struct stat info;
+    if (stat("/etc/passwd", &info) != 0)
+        return;
+    if (info.st_mtim.tv_sec != passwd_mtime.tv_sec ||
+        info.st_mtim.tv_nsec != passwd_mtime.tv_nsec) {
+        names.clear();
+        passwd_mtime = info.st_mtim;
+    }
+}
+
+double ProcReader::ReadUptime() {
+    double uptime_secs = 0.0;
+    if (ReadFile("uptime") > 0)
+        uptime_secs = strtod(buffer, nullptr);
+    return uptime_secs;
+}
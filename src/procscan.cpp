@@ -0,0 +1,735 @@
+#include "../punktop.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+
+static std::shared_ptr<const ProcSnapshot> front_snapshot; // latest published scan
+static std::shared_ptr<ProcSnapshot> retired_snapshot;     // previous one, reused once the UI drops it
+
+// One worker per ~16 cores, so small machines keep scanning serially
+std::atomic<int> procScanWorkers{
+    std::clamp((int)std::thread::hardware_concurrency() / 16, 1, 8)};
+
+// Persistent process table. Between scans only the sampler thread touches it;
+// during a scan the workers look entries up and refresh the one for their own
+// PID in place, and new entries are inserted after the workers are done.
+static std::unordered_map<ProcKey, ProcEntry, ProcKeyHash> proc_table;
+std::atomic<int> procTopN{0};
+static unsigned long long scan_count = 0;
+static double last_scan_uptime = 0.0;
+static UserCache user_cache;
+
+// Per-PID result of the parallel part of a scan
+struct ScanSlot {
+    int pid = 0;
+    bool alive = false;
+    ProcEntry *entry = nullptr; // existing table entry, refreshed in place
+    ProcEntry fresh;            // filled instead when the process is new
+};
+
+// Fixed set of helper threads for the sampler. Run() hands the same job to
+// every worker, the calling thread being worker 0, and returns once all of
+// them are done.
+class ScanPool {
+public:
+    explicit ScanPool(int workers) {
+        for (int i = 1; i < workers; i++)
+            threads.emplace_back(&ScanPool::Loop, this, i);
+    }
+
+    ~ScanPool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &t : threads)
+            t.join();
+    }
+
+    int Size() const { return (int)threads.size() + 1; }
+
+    void Run(const std::function<void(int)> &work) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            job = &work;
+            pending = (int)threads.size();
+            round++;
+        }
+        wake.notify_all();
+        work(0);
+
+        std::unique_lock<std::mutex> lock(mtx);
+        done.wait(lock, [this] { return pending == 0; });
+        job = nullptr;
+    }
+
+private:
+    void Loop(int worker) {
+        unsigned long long seen_round = 0;
+        while (true) {
+            const std::function<void(int)> *work;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                wake.wait(lock, [&] { return stopping || round != seen_round; });
+                if (stopping)
+                    return;
+                seen_round = round;
+                work = job;
+            }
+            (*work)(worker);
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                pending--;
+            }
+            done.notify_one();
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::mutex mtx;
+    std::condition_variable wake, done;
+    const std::function<void(int)> *job = nullptr;
+    unsigned long long round = 0;
+    int pending = 0;
+    bool stopping = false;
+};
+
+std::shared_ptr<const ProcSnapshot> GetProcSnapshot() {
+    return std::atomic_load(&front_snapshot);
+}
+
+// Processes the UI holds on to (pinned, expanded, selected). A top-N
+// snapshot always has them as rows too, so the UI can tell "left out" from
+// "exited". Each new set gets a version; snapshots carry the one they used.
+static std::mutex held_mtx;
+static std::unordered_set<ProcKey, ProcKeyHash> held_keys;
+static unsigned long long held_version = 0;
+
+unsigned long long KeepInSnapshot(const std::vector<ProcKey> &keys) {
+    std::lock_guard<std::mutex> lock(held_mtx);
+    held_keys.clear();
+    held_keys.insert(keys.begin(), keys.end());
+    return ++held_version;
+}
+
+ScanArena::~ScanArena() {
+    for (Block &b : blocks)
+        ::operator delete(b.data);
+}
+
+void *ScanArena::do_allocate(size_t size, size_t align) {
+    allocations++;
+    bytes += size;
+    for (; block < blocks.size(); block++, used = 0) {
+        size_t start = (used + align - 1) & ~(align - 1);
+        if (start + size <= blocks[block].size) {
+            used = start + size;
+            return blocks[block].data + start;
+        }
+    }
+
+    // Out of blocks; ::operator new is aligned enough for anything we store
+    size_t block_size = std::max<size_t>(size, 64 * 1024);
+    if (!blocks.empty())
+        block_size = std::max(block_size, blocks.back().size * 2);
+    blocks.push_back({(char *)::operator new(block_size), block_size});
+    mallocs++;
+    block = blocks.size() - 1;
+    used = size;
+    return blocks[block].data;
+}
+
+void ScanArena::Reset() {
+    // A scan that spilled over several blocks gets one block big enough
+    // for all of it, so the next scan of the same size fits without malloc
+    if (blocks.size() > 1) {
+        size_t total = 0;
+        for (Block &b : blocks) {
+            total += b.size;
+            ::operator delete(b.data);
+        }
+        blocks.assign(1, {(char *)::operator new(total), total});
+    }
+    block = 0;
+    used = 0;
+    allocations = 0;
+    bytes = 0;
+    mallocs = 0;
+}
+
+template <typename T>
+static void ReleaseColumn(std::pmr::vector<T> &column) {
+    std::pmr::vector<T>(column.get_allocator()).swap(column);
+}
+
+void ProcSnapshot::Clear() {
+    // The columns must let go of their storage before the arena rewinds
+    ReleaseColumn(pid);
+    ReleaseColumn(ppid);
+    ReleaseColumn(cpu);
+    ReleaseColumn(mem);
+    ReleaseColumn(threads);
+    ReleaseColumn(name_id);
+    ReleaseColumn(user_id);
+    ReleaseColumn(command_id);
+    ReleaseColumn(start_time);
+    ReleaseColumn(io_read);
+    ReleaseColumn(io_write);
+    ReleaseColumn(io_syscr);
+    ReleaseColumn(io_syscw);
+    ReleaseColumn(minflt);
+    ReleaseColumn(majflt);
+    ReleaseColumn(vcsw);
+    ReleaseColumn(nvcsw);
+    ReleaseColumn(subtree_cpu);
+    ReleaseColumn(subtree_mem);
+    ReleaseColumn(subtree_threads);
+    ReleaseColumn(strings.chars);
+    ReleaseColumn(strings.offsets);
+    ReleaseColumn(child_begin);
+    ReleaseColumn(child_rows);
+    ReleaseColumn(order);
+    ReleaseColumn(tree_rows);
+    ReleaseColumn(tree_depth);
+    ReleaseColumn(tree_end);
+    arena.Reset();
+    stats = ProcScanStats{};
+}
+
+// Sizes the columns once, so none of them grows (and wastes arena space) while filling
+void ProcSnapshot::Reserve(size_t rows) {
+    pid.reserve(rows);
+    ppid.reserve(rows);
+    cpu.reserve(rows);
+    mem.reserve(rows);
+    threads.reserve(rows);
+    name_id.reserve(rows);
+    user_id.reserve(rows);
+    command_id.reserve(rows);
+    start_time.reserve(rows);
+    io_read.reserve(rows);
+    io_write.reserve(rows);
+    io_syscr.reserve(rows);
+    io_syscw.reserve(rows);
+    minflt.reserve(rows);
+    majflt.reserve(rows);
+    vcsw.reserve(rows);
+    nvcsw.reserve(rows);
+    subtree_cpu.reserve(rows);
+    subtree_mem.reserve(rows);
+    subtree_threads.reserve(rows);
+    strings.offsets.reserve(rows * 3);
+    strings.chars.reserve(rows * 64);
+    child_begin.reserve(rows + 1);
+    child_rows.reserve(rows);
+    order.reserve(rows);
+    tree_rows.reserve(rows);
+    tree_depth.reserve(rows);
+    tree_end.reserve(rows);
+}
+
+// Adds str to the snapshot's pool unless an equal string is already there
+static uint32_t InternString(ProcSnapshot &snapshot,
+                             std::pmr::unordered_map<std::string_view, uint32_t> &ids,
+                             const std::string &str) {
+    auto [it, inserted] = ids.try_emplace(str, 0);
+    if (inserted)
+        it->second = snapshot.strings.Add(str);
+    return it->second;
+}
+
+// Sums every row into all of its ancestors in one bottom-up pass: a row is
+// added to its parent once all of its own children have been added to it.
+static void RollUpSubtrees(ProcSnapshot &snapshot, const std::pmr::vector<int32_t> &parent_row) {
+    int rows = snapshot.Size();
+    snapshot.subtree_cpu.assign(snapshot.cpu.begin(), snapshot.cpu.end());
+    snapshot.subtree_mem.assign(snapshot.mem.begin(), snapshot.mem.end());
+    snapshot.subtree_threads.assign(snapshot.threads.begin(), snapshot.threads.end());
+
+    std::pmr::vector<int32_t> pending_children(rows, 0, &snapshot.arena);
+    for (int row = 0; row < rows; row++)
+        if (parent_row[row] >= 0)
+            pending_children[parent_row[row]]++;
+
+    std::pmr::vector<int32_t> ready(&snapshot.arena); // rows whose subtree is complete
+    ready.reserve(rows);
+    for (int row = 0; row < rows; row++)
+        if (pending_children[row] == 0)
+            ready.push_back(row);
+
+    while (!ready.empty()) {
+        int row = ready.back();
+        ready.pop_back();
+        int parent = parent_row[row];
+        if (parent < 0)
+            continue;
+        snapshot.subtree_cpu[parent] += snapshot.subtree_cpu[row];
+        snapshot.subtree_mem[parent] += snapshot.subtree_mem[row];
+        snapshot.subtree_threads[parent] += snapshot.subtree_threads[row];
+        if (--pending_children[parent] == 0)
+            ready.push_back(parent);
+    }
+}
+
+// Lays a tree out in preorder with an explicit stack, so deep trees can't
+// overflow anything and the UI never has to walk parents. Children of row i
+// are children[child_begin[i] .. child_begin[i + 1]), each list in display
+// order; roots come in display order too.
+void LayOutTree(const std::pmr::vector<int32_t> &child_begin, const std::pmr::vector<int32_t> &children,
+                const std::pmr::vector<int32_t> &roots, std::pmr::vector<int32_t> &rows,
+                std::pmr::vector<int32_t> &depth, std::pmr::vector<int32_t> &end) {
+    struct Frame {
+        int32_t pos;  // where the node went in rows
+        int32_t next; // next index into children
+        int32_t end;
+    };
+    std::pmr::vector<Frame> stack(rows.get_allocator().resource());
+    rows.clear();
+    depth.clear();
+    end.clear();
+
+    auto emit = [&](int32_t row) {
+        int32_t pos = (int32_t)rows.size();
+        rows.push_back(row);
+        depth.push_back((int32_t)stack.size());
+        end.push_back(pos + 1);
+        stack.push_back({pos, child_begin[row], child_begin[row + 1]});
+    };
+
+    for (int32_t root : roots) {
+        emit(root);
+        while (!stack.empty()) {
+            Frame &frame = stack.back();
+            if (frame.next < frame.end) {
+                emit(children[frame.next++]);
+            } else {
+                end[frame.pos] = (int32_t)rows.size();
+                stack.pop_back();
+            }
+        }
+    }
+}
+
+static void FlattenTree(ProcSnapshot &snapshot, const std::pmr::vector<int32_t> &parent_row) {
+    std::pmr::vector<int32_t> roots(&snapshot.arena);
+    for (int32_t row : snapshot.order)
+        if (parent_row[row] < 0)
+            roots.push_back(row);
+    LayOutTree(snapshot.child_begin, snapshot.child_rows, roots, snapshot.tree_rows,
+               snapshot.tree_depth, snapshot.tree_end);
+}
+
+// The fields that cost a syscall or an NSS lookup of their own
+static void LoadDetails(ProcEntry &proc_entry, ProcReader &reader) {
+    proc_entry.user = user_cache.Lookup(proc_entry.sample.uid);
+    proc_entry.command = reader.ReadCommand(proc_entry.pid);
+    proc_entry.details = true;
+}
+
+// Metric a top-N scan ranks by, or null if the mode can't be done that way
+static float (*TopNMetric(SortMode mode))(const ProcEntry &) {
+    switch (mode) {
+    case cpu_sort:
+        return [](const ProcEntry &e) { return e.cpu_usage; };
+    case mem_sort:
+        return [](const ProcEntry &e) { return (float)e.sample.rss_kb; };
+    case thread_sort:
+        return [](const ProcEntry &e) { return (float)e.sample.threads; };
+    case io_read_sort:
+        return [](const ProcEntry &e) { return e.io_read_rate; };
+    case io_write_sort:
+        return [](const ProcEntry &e) { return e.io_write_rate; };
+    case minflt_sort:
+        return [](const ProcEntry &e) { return e.minflt_rate; };
+    case majflt_sort:
+        return [](const ProcEntry &e) { return e.majflt_rate; };
+    case vcsw_sort:
+        return [](const ProcEntry &e) { return e.vcsw_rate; };
+    case nvcsw_sort:
+        return [](const ProcEntry &e) { return e.nvcsw_rate; };
+    default:
+        return nullptr;
+    }
+}
+
+// Per-second rates of the cumulative counters since the entry's previous
+// sample, over the same interval as the CPU delta. Runs before the new
+// sample replaces the old one, which still holds the previous counters.
+static void UpdateRates(ProcEntry &entry, const ProcSample &sample, double uptime_secs) {
+    const ProcSample &prev = entry.sample;
+    double seconds = uptime_secs - entry.prev_uptime;
+    bool baseline = entry.prev_uptime > 0.0 && seconds > 0.0;
+    auto rate = [&](unsigned long long now, unsigned long long before) {
+        return baseline && now >= before ? (float)((now - before) / seconds) : 0.0f;
+    };
+    entry.minflt_rate = rate(sample.minflt, prev.minflt);
+    entry.majflt_rate = rate(sample.majflt, prev.majflt);
+    entry.vcsw_rate = rate(sample.vcsw, prev.vcsw);
+    entry.nvcsw_rate = rate(sample.nvcsw, prev.nvcsw);
+
+    if (!sample.io) {
+        entry.io_read_rate = entry.io_write_rate = -1.0f;
+        entry.syscr_rate = entry.syscw_rate = -1.0f;
+        return;
+    }
+    baseline = baseline && prev.io;
+    entry.io_read_rate = rate(sample.read_bytes, prev.read_bytes);
+    entry.io_write_rate = rate(sample.write_bytes, prev.write_bytes);
+    entry.syscr_rate = rate(sample.syscr, prev.syscr);
+    entry.syscw_rate = rate(sample.syscw, prev.syscw);
+}
+
+// Reads one PID. Runs on the scan workers, so it only reads proc_table and
+// writes to the slot or to the entry that belongs to this PID.
+static void ScanPid(ScanSlot &slot, ProcReader &reader, double uptime_secs, long clk_tck,
+                    bool defer_details) {
+    ProcSample sample;
+    slot.entry = nullptr;
+    slot.alive = reader.Read(slot.pid, sample);
+    if (!slot.alive)
+        return; // exited while we were scanning
+
+    ProcEntry *proc_entry;
+    auto it = proc_table.find(ProcKey{slot.pid, sample.start_time});
+    if (it != proc_table.end()) {
+        proc_entry = slot.entry = &it->second;
+        // An exec no event told us about: command and user may have changed too
+        if (proc_entry->name != sample.name) {
+            proc_entry->name = sample.name;
+            proc_entry->details = false;
+            proc_entry->io_denied = false;
+        }
+    } else {
+        proc_entry = &slot.fresh;
+        proc_entry->pid = slot.pid;
+        proc_entry->name = sample.name;
+        proc_entry->details = false;
+        proc_entry->io_denied = false;
+        proc_entry->prev_ticks = 0;
+        proc_entry->prev_uptime = 0.0;
+        // Like prev_ticks: a process born this interval started its counters at zero
+        proc_entry->sample = ProcSample{};
+        proc_entry->sample.io = true;
+
+        // Started since the last scan: its whole life is inside
+        // this interval. Otherwise wait one scan for a baseline.
+        double start_secs = sample.start_time / (double)clk_tck;
+        if (last_scan_uptime > 0.0 && start_secs >= last_scan_uptime)
+            proc_entry->prev_uptime = start_secs;
+    }
+    // io of another user's process stays unreadable; don't ask every scan
+    if (!proc_entry->io_denied && !reader.ReadIo(slot.pid, sample) && errno == EACCES)
+        proc_entry->io_denied = true;
+    UpdateRates(*proc_entry, sample, uptime_secs);
+    proc_entry->sample = sample;
+    proc_entry->cpu_usage = GetProcCpuUsage(*proc_entry, uptime_secs);
+    proc_entry->seen_scan = scan_count;
+    if (!defer_details && !proc_entry->details)
+        LoadDetails(*proc_entry, reader);
+}
+
+// Brings a process captured by the proc connector into the table: new ones
+// are inserted, an exec refreshes the name, command and user of a known one.
+static void MergeCapture(ProcEntry &capture, long clk_tck) {
+    ProcKey key{capture.pid, capture.sample.start_time};
+    auto it = proc_table.find(key);
+    if (it != proc_table.end()) {
+        it->second.name = std::move(capture.name);
+        it->second.command = std::move(capture.command);
+        // A setuid exec changes the owner, and with it who may read io
+        it->second.user = user_cache.Lookup(capture.sample.uid);
+        it->second.io_denied = false;
+        return;
+    }
+
+    capture.user = user_cache.Lookup(capture.sample.uid);
+    capture.details = true; // the listener already read the command
+    capture.prev_ticks = 0;
+    capture.prev_uptime = 0.0;
+    // Counters start at zero like prev_ticks, so the first rates cover its whole life
+    capture.sample.minflt = capture.sample.majflt = 0;
+    capture.sample.vcsw = capture.sample.nvcsw = 0;
+    capture.sample.io = true; // not read by the listener, zero as well
+    double start_secs = capture.sample.start_time / (double)clk_tck;
+    if (last_scan_uptime > 0.0 && start_secs >= last_scan_uptime)
+        capture.prev_uptime = start_secs;
+    capture.seen_scan = 0; // not part of any scan yet
+    proc_table.emplace(key, std::move(capture));
+}
+
+static void ScanProcesses(ProcSnapshot &snapshot, ProcDir &proc_dir, ScanPool &pool,
+                          std::vector<ProcReader> &readers) {
+    auto scan_start = std::chrono::steady_clock::now();
+    snapshot.Clear();
+    proc_dir.syscalls = 0;
+    for (ProcReader &reader : readers) {
+        reader.proc_fd = proc_dir.Fd();
+        reader.syscalls = 0;
+    }
+    scan_count++;
+    // One uptime read per scan is the time base for every CPU delta
+    double uptime_secs = readers[0].ReadUptime();
+    long clk_tck = sysconf(_SC_CLK_TCK);
+    user_cache.Revalidate();
+    try {
+        static std::vector<ProcEntry> captured;
+        bool missed_events = false;
+        bool events = DrainProcEvents(captured, missed_events);
+        for (ProcEntry &capture : captured)
+            MergeCapture(capture, clk_tck);
+
+        // With the connector, the table already knows every live process, so
+        // listing /proc is only needed at startup, after dropped events, and
+        // now and then to catch anything the events missed
+        static std::vector<int> pids;
+        static unsigned long long last_listing = 0;
+        bool listed;
+        if (events && !missed_events && !proc_table.empty() &&
+            scan_count - last_listing < PROC_RESYNC_SCANS) {
+            pids.clear();
+            for (const auto &[key, proc_entry] : proc_table)
+                pids.push_back(key.pid);
+            std::sort(pids.begin(), pids.end());
+            pids.erase(std::unique(pids.begin(), pids.end()), pids.end());
+            listed = true;
+        } else {
+            listed = proc_dir.ListPids(pids);
+            last_listing = scan_count;
+        }
+        snapshot.stats.events = events;
+
+        if (listed) {
+            static std::vector<ScanSlot> slots; // reused across scans
+            size_t count = pids.size();
+            if (slots.size() < count)
+                slots.resize(count);
+            for (size_t i = 0; i < count; i++)
+                slots[i].pid = pids[i];
+
+            // Top-N: everything is read cheaply, but only the N heaviest become
+            // rows, and only they get their user and command
+            SortMode mode = sortMode.load();
+            float (*top_metric)(const ProcEntry &) = TopNMetric(mode);
+            size_t top_n = top_metric ? (size_t)std::max(0, procTopN.load()) : 0;
+            static std::unordered_set<ProcKey, ProcKeyHash> held;
+            {
+                std::lock_guard<std::mutex> lock(held_mtx);
+                held = held_keys;
+                snapshot.held_version = held_version;
+            }
+
+            // Workers pull small chunks of PIDs until none are left
+            const size_t chunk = 64;
+            std::atomic<size_t> next{0};
+            pool.Run([&](int worker) {
+                ProcReader &reader = readers[worker];
+                size_t begin;
+                while ((begin = next.fetch_add(chunk)) < count) {
+                    size_t end = std::min(count, begin + chunk);
+                    for (size_t i = begin; i < end; i++)
+                        ScanPid(slots[i], reader, uptime_secs, clk_tck, top_n > 0);
+                }
+            });
+
+            // Merge: insert new processes, keep /proc order (references survive rehashing).
+            // Scratch containers live in the snapshot arena like the columns.
+            std::pmr::memory_resource *arena = &snapshot.arena;
+            snapshot.Reserve(count);
+            std::pmr::vector<ProcEntry *> seen(arena);
+            seen.reserve(top_n ? std::min(top_n, count) : count);
+            // Min-heap on the metric: the front is the lightest of the current top N
+            auto heavier = [top_metric](const ProcEntry *a, const ProcEntry *b) {
+                return top_metric(*a) > top_metric(*b);
+            };
+            std::pmr::vector<ProcEntry *> kept(arena); // held ones, rows whatever their metric
+            size_t scanned = 0;
+            for (size_t i = 0; i < count; i++) {
+                ScanSlot &slot = slots[i];
+                if (!slot.alive)
+                    continue;
+                ProcEntry *proc_entry = slot.entry;
+                if (!proc_entry) {
+                    ProcKey key{slot.pid, slot.fresh.sample.start_time};
+                    proc_entry = &proc_table.insert_or_assign(key, std::move(slot.fresh)).first->second;
+                }
+                scanned++;
+
+                if (!top_n) {
+                    seen.push_back(proc_entry);
+                } else if (!held.empty() &&
+                           held.count(ProcKey{slot.pid, proc_entry->sample.start_time})) {
+                    kept.push_back(proc_entry);
+                } else if (seen.size() < top_n) {
+                    seen.push_back(proc_entry);
+                    std::push_heap(seen.begin(), seen.end(), heavier);
+                } else if (top_metric(*proc_entry) > top_metric(*seen.front())) {
+                    std::pop_heap(seen.begin(), seen.end(), heavier);
+                    seen.back() = proc_entry;
+                    std::push_heap(seen.begin(), seen.end(), heavier);
+                }
+            }
+            seen.insert(seen.end(), kept.begin(), kept.end());
+            snapshot.stats.scanned = scanned;
+            snapshot.stats.top_n = (int)top_n;
+            for (ProcEntry *proc_entry : seen)
+                if (!proc_entry->details)
+                    LoadDetails(*proc_entry, readers[0]);
+
+            float cpu_scale = 1.0f;
+            if (cpuMode == cpu_all_cores)
+                cpu_scale = 1.0f / std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+            // Fill the columns. Interned views point into the table entries,
+            // which stay put until the reap below.
+            std::pmr::unordered_map<std::string_view, uint32_t> string_ids(arena);
+            string_ids.reserve(count * 2);
+            for (const ProcEntry *proc_entry : seen) {
+                snapshot.pid.push_back(proc_entry->pid);
+                snapshot.ppid.push_back(proc_entry->sample.ppid);
+                snapshot.cpu.push_back(proc_entry->cpu_usage * cpu_scale);
+                snapshot.mem.push_back((float)proc_entry->sample.rss_kb);
+                snapshot.threads.push_back(proc_entry->sample.threads);
+                snapshot.name_id.push_back(InternString(snapshot, string_ids, proc_entry->name));
+                snapshot.user_id.push_back(InternString(snapshot, string_ids, proc_entry->user));
+                snapshot.command_id.push_back(InternString(snapshot, string_ids, proc_entry->command));
+                snapshot.start_time.push_back(proc_entry->sample.start_time);
+                snapshot.io_read.push_back(proc_entry->io_read_rate);
+                snapshot.io_write.push_back(proc_entry->io_write_rate);
+                snapshot.io_syscr.push_back(proc_entry->syscr_rate);
+                snapshot.io_syscw.push_back(proc_entry->syscw_rate);
+                snapshot.minflt.push_back(proc_entry->minflt_rate);
+                snapshot.majflt.push_back(proc_entry->majflt_rate);
+                snapshot.vcsw.push_back(proc_entry->vcsw_rate);
+                snapshot.nvcsw.push_back(proc_entry->nvcsw_rate);
+            }
+            int rows = snapshot.Size();
+
+            // Reap processes that exited (or whose PID got recycled) since the last scan
+            for (auto it = proc_table.begin(); it != proc_table.end();) {
+                if (it->second.seen_scan != scan_count) {
+                    if (it->second.seen_scan == 0)
+                        procEventOnly++; // captured by an event, gone before any scan
+                    it = proc_table.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+
+            // Parent-child relationships as index arrays; children keep sort order
+            std::pmr::unordered_map<int32_t, int32_t> pid_to_row(arena);
+            pid_to_row.reserve(rows);
+            for (int row = 0; row < rows; row++)
+                pid_to_row[snapshot.pid[row]] = row;
+
+            std::pmr::vector<int32_t> parent_row(rows, -1, arena);
+            for (int row = 0; row < rows; row++) {
+                auto it = pid_to_row.find(snapshot.ppid[row]);
+                if (it != pid_to_row.end())
+                    parent_row[row] = it->second;
+            }
+
+            // Before sorting, so the subtree sort modes can use the totals
+            RollUpSubtrees(snapshot, parent_row);
+
+            snapshot.order.resize(rows);
+            std::iota(snapshot.order.begin(), snapshot.order.end(), 0);
+            if (mode != no_sort)
+                SortProcesses(snapshot, &mode, 1, snapshot.order);
+
+            snapshot.child_begin.assign(rows + 1, 0);
+            for (int row = 0; row < rows; row++)
+                if (parent_row[row] >= 0)
+                    snapshot.child_begin[parent_row[row] + 1]++;
+            for (int row = 0; row < rows; row++)
+                snapshot.child_begin[row + 1] += snapshot.child_begin[row];
+            snapshot.child_rows.resize(snapshot.child_begin[rows]);
+            std::pmr::vector<int32_t> fill(snapshot.child_begin.begin(), snapshot.child_begin.end() - 1, arena);
+            for (int row : snapshot.order)
+                if (parent_row[row] >= 0)
+                    snapshot.child_rows[fill[parent_row[row]]++] = row;
+
+            FlattenTree(snapshot, parent_row);
+        } else {
+            std::cerr << "[ERROR] Failed listing /proc\n";
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "[ERROR] " << e.what() << "\n";
+    }
+    last_scan_uptime = uptime_secs;
+    snapshot.stats.processes = snapshot.pid.size();
+    snapshot.stats.syscalls = proc_dir.syscalls;
+    snapshot.stats.event_only = procEventOnly;
+    for (const ProcReader &reader : readers)
+        snapshot.stats.syscalls += reader.syscalls;
+    snapshot.stats.workers = pool.Size();
+    snapshot.stats.arena_allocations = snapshot.arena.allocations;
+    snapshot.stats.arena_bytes = snapshot.arena.bytes;
+    snapshot.stats.arena_mallocs = snapshot.arena.mallocs;
+    snapshot.stats.scan_ms = std::chrono::duration<float, std::milli>(
+        std::chrono::steady_clock::now() - scan_start).count();
+}
+
+// Process sampler thread. Each scan is built into a back buffer and then
+// published with an atomic swap, so the render loop never touches /proc.
+void FetchProcesses() {
+    unsigned long long generation = 0;
+    ProcDir proc_dir;
+    // Subscribe before the first listing so nothing forked in between is lost
+    StartProcEvents();
+    std::unique_ptr<ScanPool> pool;
+    std::vector<ProcReader> readers; // one parse buffer per worker
+    while (!is_finished) {
+        int workers = std::clamp(procScanWorkers.load(), 1, MAX_SCAN_WORKERS);
+        if (!pool || pool->Size() != workers) {
+            pool.reset(); // join the old threads first
+            pool = std::make_unique<ScanPool>(workers);
+            readers.resize(workers);
+        }
+
+        std::shared_ptr<ProcSnapshot> back;
+        // Reuse the retired buffer (and its capacity) once no frame holds it anymore
+        if (retired_snapshot && retired_snapshot.use_count() == 1) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            back = std::move(retired_snapshot);
+        } else {
+            back = std::make_shared<ProcSnapshot>();
+        }
+
+        ScanProcesses(*back, proc_dir, *pool, readers);
+        back->generation = ++generation;
+        RecordProcHistory(*back);
+
+        std::shared_ptr<const ProcSnapshot> old =
+            std::atomic_exchange(&front_snapshot, std::shared_ptr<const ProcSnapshot>(back));
+        retired_snapshot = std::const_pointer_cast<ProcSnapshot>(old);
+
+        // smaps_rollup and task walks can take a while for big processes;
+        // they go after the publish so they never hold a snapshot back
+        SampleProcMemory(*back, readers[0]);
+        SampleProcThreads(*back, readers[0]);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(PROC_REFRESH_MS));
+    }
+}
+
+// CPU% over the interval since the entry's previous sample, 100% = one core.
+// Also moves the baseline forward to this sample.
+float GetProcCpuUsage(ProcEntry &entry, double uptime_secs) {
+    long clk_tck = sysconf(_SC_CLK_TCK);
+    unsigned long long ticks = entry.sample.utime + entry.sample.stime;
+
+    float cpu_usage = 0.0f;
+    double seconds = uptime_secs - entry.prev_uptime;
+    if (entry.prev_uptime > 0.0 && seconds > 0.0 && ticks >= entry.prev_ticks)
+        cpu_usage = (float)(100.0 * ((ticks - entry.prev_ticks) / (double)clk_tck) / seconds);
+
+    entry.prev_ticks = ticks;
+    entry.prev_uptime = uptime_secs;
+    return cpu_usage;
+}
@@ -0,0 +1,121 @@
+#include "../punktop.h"
+#include <algorithm>
+#include <cstring>
+
+// Per-thread CPU for the processes the UI has expanded or pinned. Walking
+// /proc/[pid]/task costs a stat read per thread, so normal scans never do
+// it; only the wanted set is walked, after a scan.
+struct ThreadWatch {
+    unsigned long long start_time = 0;
+    double prev_uptime = 0.0;          // 0 = no baseline yet
+    std::unordered_map<int, unsigned long long> prev_ticks; // tid -> utime + stime
+};
+
+static std::mutex threads_mtx;
+static WantedPids wanted;
+static std::unordered_map<int, std::shared_ptr<const ProcThreadList>> published;
+static std::unordered_map<int, ThreadWatch> watches; // sampler thread only
+
+void SampleProcThreads(const ProcSnapshot &snapshot, ProcReader &reader) {
+    static std::unordered_map<int, unsigned long long> requests;
+    wanted.Take(requests);
+    {
+        std::lock_guard<std::mutex> lock(threads_mtx);
+        if (requests.empty() && published.empty())
+            return;
+    }
+
+    // Nobody asked since the last scan: the baseline goes too
+    for (auto it = watches.begin(); it != watches.end();) {
+        if (!requests.count(it->first))
+            it = watches.erase(it);
+        else
+            ++it;
+    }
+
+    double uptime_secs = reader.ReadUptime();
+    long clk_tck = sysconf(_SC_CLK_TCK);
+    float cpu_scale = 1.0f;
+    if (cpuMode == cpu_all_cores)
+        cpu_scale = 1.0f / std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+    std::unordered_map<int, std::shared_ptr<const ProcThreadList>> lists;
+    std::vector<int> tids;
+    for (const auto &[pid, start_time] : requests) {
+        ThreadWatch &watch = watches[pid];
+        if (watch.start_time != start_time) {
+            watch = ThreadWatch{};
+            watch.start_time = start_time;
+        }
+        // The PID may belong to another process by now; its threads aren't ours
+        ProcSample owner;
+        if (!reader.Read(pid, owner) || owner.start_time != start_time ||
+            !reader.ListTasks(pid, tids)) {
+            watches.erase(pid); // exited or recycled
+            continue;
+        }
+
+        auto list = std::make_shared<ProcThreadList>();
+        list->pid = pid;
+        list->start_time = start_time;
+        list->threads.reserve(tids.size());
+
+        std::unordered_map<int, unsigned long long> ticks_now;
+        ticks_now.reserve(tids.size());
+        for (int tid : tids) {
+            ProcSample sample;
+            if (!reader.ReadTask(pid, tid, sample))
+                continue; // thread exited meanwhile
+            unsigned long long ticks = sample.utime + sample.stime;
+            ticks_now[tid] = ticks;
+
+            // Same rules as processes: a thread started this interval is
+            // measured over its whole life
+            double since = watch.prev_uptime;
+            unsigned long long prev = 0;
+            auto it = watch.prev_ticks.find(tid);
+            if (it != watch.prev_ticks.end())
+                prev = it->second;
+            else if (since > 0.0)
+                since = std::max(since, sample.start_time / (double)clk_tck);
+
+            ProcThread thread;
+            thread.tid = tid;
+            thread.state = sample.state;
+            memcpy(thread.name, sample.name, sizeof(thread.name) - 1);
+            double seconds = uptime_secs - since;
+            if (since > 0.0 && seconds > 0.0 && ticks >= prev)
+                thread.cpu = (float)(100.0 * ((ticks - prev) / (double)clk_tck) / seconds) * cpu_scale;
+            list->threads.push_back(thread);
+        }
+        std::sort(list->threads.begin(), list->threads.end(),
+                  [](const ProcThread &a, const ProcThread &b) {
+                      return a.cpu != b.cpu ? a.cpu > b.cpu : a.tid < b.tid;
+                  });
+
+        // Recycled during the walk: drop what was read
+        if (!reader.Read(pid, owner) || owner.start_time != start_time) {
+            watches.erase(pid);
+            continue;
+        }
+        watch.prev_ticks.swap(ticks_now);
+        watch.prev_uptime = uptime_secs;
+        lists[pid] = std::move(list);
+    }
+
+    std::lock_guard<std::mutex> lock(threads_mtx);
+    published.swap(lists);
+}
+
+// Threads of the process as of the last scan, or null before the first
+// sample. Also asks for the next one, so only processes the UI is showing
+// or has pinned are ever walked.
+std::shared_ptr<const ProcThreadList> GetProcThreads(int pid, unsigned long long start_time) {
+    wanted.Want(pid, start_time);
+    std::lock_guard<std::mutex> lock(threads_mtx);
+
+    auto it = published.find(pid);
+    if (it == published.end() || it->second->start_time != start_time)
+        return nullptr;
+    return it->second;
+}
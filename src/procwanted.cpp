@@ -0,0 +1,17 @@
+#include "../punktop.h"
+
+static const size_t max_wanted = 256;
+
+// A PID already in the set is always updated, so a full set still follows
+// the rows that keep being drawn
+void WantedPids::Want(int pid, unsigned long long start_time) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (pids.size() < max_wanted || pids.count(pid))
+        pids[pid] = start_time;
+}
+
+void WantedPids::Take(std::unordered_map<int, unsigned long long> &out) {
+    out.clear();
+    std::lock_guard<std::mutex> lock(mtx);
+    out.swap(pids);
+}
@@ -0,0 +1,196 @@
+#include "../punktop.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+// Pinned and expanded processes are held by pidfd. A pidfd always refers to
+// the process it was opened for, so its exit is seen as soon as it happens
+// (the fd turns readable in the epoll set) and a signal sent through it can
+// never reach a process that got the PID afterwards.
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+
+static int PidfdOpen(int pid) {
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+static int PidfdSendSignal(int pidfd, int sig) {
+    return (int)syscall(SYS_pidfd_send_signal, pidfd, sig, nullptr, 0);
+}
+
+struct Watch {
+    unsigned long long start_time;
+    int pidfd;
+};
+
+static std::mutex watch_mtx;
+static std::unordered_map<int, Watch> watches; // pid -> held pidfd
+static std::vector<ProcKey> exited;            // seen by the epoll thread, not drained yet
+static int epoll_fd = -1;
+static bool pidfd_unsupported = false; // kernel older than 5.3
+static bool open_failure_logged = false;
+
+// Resolve the start time that proves a fresh pidfd is for the process we
+// meant. Shared by the UI and the batch worker, so only used under watch_mtx.
+static ProcDir watch_proc_dir;
+static ProcReader watch_reader;
+
+static void WatchExits() {
+    struct epoll_event events[16];
+    while (!is_finished) {
+        int n = epoll_wait(epoll_fd, events, 16, 500);
+        if (n < 0 && errno != EINTR) {
+            std::cerr << "[ERROR] epoll_wait failed on pidfds\n";
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(watch_mtx);
+        for (int i = 0; i < n; i++) {
+            int pid = (int)(events[i].data.u64 >> 32);
+            int pidfd = (int)(events[i].data.u64 & 0xffffffff);
+            auto it = watches.find(pid);
+            if (it == watches.end() || it->second.pidfd != pidfd)
+                continue; // unwatched meanwhile
+            exited.push_back({pid, it->second.start_time});
+            close(pidfd); // also takes it out of the epoll set
+            watches.erase(it);
+        }
+    }
+}
+
+// Whether /proc/[pid] is still the process that started at start_time. If
+// not, errno is ESRCH, or why stat couldn't be read (EMFILE doesn't mean
+// the process is gone).
+static bool IsSameProcess(int pid, unsigned long long start_time) {
+    watch_reader.proc_fd = watch_proc_dir.Fd();
+    ProcSample sample;
+    errno = 0;
+    bool read = watch_reader.Read(pid, sample);
+    if (read && sample.start_time == start_time)
+        return true;
+    if (read || errno == 0 || errno == ENOENT)
+        errno = ESRCH;
+    return false;
+}
+
+// Opens a pidfd for the process with this PID and start time. On failure
+// errno is ESRCH if that process is gone; anything else (EMFILE, ENOMEM,
+// ENOSYS) says nothing about it. The start time is checked after opening:
+// if it still matches, the PID was not recycled before the pidfd pinned it.
+static int OpenPidfd(int pid, unsigned long long start_time) {
+    if (pidfd_unsupported) {
+        errno = ENOSYS;
+        return -1;
+    }
+    int pidfd = PidfdOpen(pid);
+    if (pidfd < 0) {
+        if (errno == ENOSYS) {
+            std::cout << "[INFO] pidfd_open unsupported, pinned processes are polled\n";
+            pidfd_unsupported = true;
+        }
+        return -1;
+    }
+
+    if (!IsSameProcess(pid, start_time)) {
+        int error = errno;
+        close(pidfd);
+        errno = error;
+        return -1;
+    }
+    return pidfd;
+}
+
+// Makes keys the set of held processes: new ones get a pidfd, dropped
+// ones give theirs back. Processes already gone are reported as exited.
+void WatchProcesses(const std::vector<ProcKey> &keys) {
+    std::lock_guard<std::mutex> lock(watch_mtx);
+    for (auto it = watches.begin(); it != watches.end();) {
+        bool kept = false;
+        for (const ProcKey &key : keys)
+            kept |= key.pid == it->first && key.start_time == it->second.start_time;
+        if (!kept) {
+            close(it->second.pidfd);
+            it = watches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (const ProcKey &key : keys) {
+        if (watches.count(key.pid))
+            continue;
+        if (epoll_fd < 0 && !pidfd_unsupported) {
+            epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if (epoll_fd < 0) {
+                std::cerr << "[ERROR] epoll_create1 failed\n";
+                pidfd_unsupported = true;
+                return;
+            }
+            std::thread watcher(WatchExits);
+            watcher.detach();
+        }
+
+        // Out of fds or memory: the process stays unwatched and the scans
+        // catch its exit instead. Opening is retried on the next call.
+        int pidfd = OpenPidfd(key.pid, key.start_time);
+        if (pidfd < 0) {
+            if (errno == ESRCH) {
+                exited.push_back(key);
+            } else if (!pidfd_unsupported && !open_failure_logged) {
+                std::cerr << "[ERROR] pidfd_open failed: " << strerror(errno)
+                          << ", some held processes are polled\n";
+                open_failure_logged = true;
+            }
+            continue;
+        }
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = ((uint64_t)key.pid << 32) | (uint32_t)pidfd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pidfd, &event) != 0) {
+            std::cerr << "[ERROR] epoll_ctl failed on a pidfd: " << strerror(errno) << "\n";
+            close(pidfd);
+            continue;
+        }
+        watches[key.pid] = {key.start_time, pidfd};
+    }
+}
+
+// Held processes that exited since the last call
+bool DrainExitedProcesses(std::vector<ProcKey> &out) {
+    std::lock_guard<std::mutex> lock(watch_mtx);
+    out.swap(exited);
+    exited.clear();
+    return !out.empty();
+}
+
+// Signals the process with this PID and start time, never one that reused
+// the PID. Held processes are signalled through their pidfd; others get a
+// short-lived one. Without pidfd support, or when none can be opened (out of
+// fds), the start time is checked right before kill(), which narrows the
+// race but can't close it. On failure errno is ESRCH if the process is gone.
+bool SignalProcess(int pid, unsigned long long start_time, int sig) {
+    std::lock_guard<std::mutex> lock(watch_mtx);
+    auto it = watches.find(pid);
+    if (it != watches.end() && it->second.start_time == start_time)
+        return PidfdSendSignal(it->second.pidfd, sig) == 0;
+
+    int pidfd = OpenPidfd(pid, start_time);
+    if (pidfd >= 0) {
+        bool sent = PidfdSendSignal(pidfd, sig) == 0;
+        close(pidfd);
+        return sent;
+    }
+    if (errno == ESRCH)
+        return false; // already gone
+
+    if (!IsSameProcess(pid, start_time))
+        return false;
+    return kill(pid, sig) == 0;
+}